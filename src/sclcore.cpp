@@ -2,8 +2,19 @@
  *  Core scl utilities
  */
 
+// 64 bit off_t for fseeko/ftello, on 32 bit systems. Only works if nothing
+// included a system header before, so builds should define it themselves.
+#ifndef _FILE_OFFSET_BITS
+#  define _FILE_OFFSET_BITS 64
+#endif
+
 #include <mutex>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <condition_variable>
 #include "sclcore.hpp"
+#include "sclnum.hpp"
 #include "sclpath.hpp"
 #include "sclpack.hpp"
 
@@ -12,6 +23,7 @@
 #    define WIN32_LEAN_AND_MEAN
 #  endif
 #  include <windows.h>
+#  include <io.h>
 #  undef min
 #  undef max
 #  ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
@@ -20,6 +32,22 @@
 #else
 #  include <unistd.h>
 #  include <math.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/uio.h>
+#  include <errno.h>
+static_assert(sizeof(off_t) >= 8,
+  "SCL needs a 64 bit off_t, define _FILE_OFFSET_BITS=64 for the whole build");
+#endif
+#ifdef __linux__
+#  include <sys/sendfile.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define SCL_SSE2
 #endif
 
 #define SCL_MAX_REFS 4096
@@ -46,7 +74,87 @@ static uint64_t fasthash64_mix(uint64_t h) {
   return h;
 }
 
-static uint64_t fasthash64(const void* m_buf, size_t len, uint64_t seed) {
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGH 0x8080808080808080ULL
+
+/* Sets 0x20 in every byte of v that is in [lo, hi]. Only ASCII bytes are
+ * considered, so UTF-8 sequences are left alone. */
+static uint64_t swar_range(uint64_t v, unsigned char lo, unsigned char hi) {
+  uint64_t h  = v & ~SWAR_HIGH;
+  uint64_t ge = h + SWAR_ONES * (0x80 - lo);
+  uint64_t gt = h + SWAR_ONES * (0x80 - hi - 1);
+  return ((ge & ~gt & ~v) & SWAR_HIGH) >> 2;
+}
+
+static uint64_t swar_lower(uint64_t v) {
+  return v | swar_range(v, 'A', 'Z');
+}
+
+static char ascii_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+}
+
+/* Flips the case of every ASCII char in [lo, hi]. */
+static void ascii_case(char* s, size_t n, char lo, char hi) {
+  size_t i = 0;
+#ifdef SCL_SSE2
+  // Signed compare trick: (c - lo) < (hi - lo + 1) in unsigned terms
+  const __m128i off  = _mm_set1_epi8((char)(0x80 - lo));
+  const __m128i lim  = _mm_set1_epi8((char)(0x80 + (hi - lo + 1)));
+  const __m128i flip = _mm_set1_epi8(0x20);
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i m = _mm_cmplt_epi8(_mm_add_epi8(v, off), lim);
+    v         = _mm_xor_si128(v, _mm_and_si128(m, flip));
+    _mm_storeu_si128((__m128i*)(s + i), v);
+  }
+#endif
+  for(; i + 8 <= n; i += 8) {
+    uint64_t v;
+    memcpy(&v, s + i, 8);
+    v ^= swar_range(v, lo, hi);
+    memcpy(s + i, &v, 8);
+  }
+  for(; i < n; i++) {
+    if(s[i] >= lo && s[i] <= hi)
+      s[i] ^= 0x20;
+  }
+}
+
+static bool ascii_iequals(const char* a, const char* b, size_t n) {
+  size_t i = 0;
+#ifdef SCL_SSE2
+  const __m128i off  = _mm_set1_epi8((char)(0x80 - 'A'));
+  const __m128i lim  = _mm_set1_epi8((char)(0x80 + 26));
+  const __m128i flip = _mm_set1_epi8(0x20);
+  for(; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+    va = _mm_or_si128(va,
+      _mm_and_si128(_mm_cmplt_epi8(_mm_add_epi8(va, off), lim), flip));
+    vb = _mm_or_si128(vb,
+      _mm_and_si128(_mm_cmplt_epi8(_mm_add_epi8(vb, off), lim), flip));
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff)
+      return false;
+  }
+#endif
+  for(; i + 8 <= n; i += 8) {
+    uint64_t va, vb;
+    memcpy(&va, a + i, 8);
+    memcpy(&vb, b + i, 8);
+    if(swar_lower(va) != swar_lower(vb))
+      return false;
+  }
+  for(; i < n; i++) {
+    if(ascii_lower(a[i]) != ascii_lower(b[i]))
+      return false;
+  }
+  return true;
+}
+
+/* If lower is set, hashes as if the input was converted to lowercase. */
+static uint64_t fasthash64(const void* m_buf, size_t len, uint64_t seed,
+  bool lower = false) {
   const uint64_t       m   = 0x880355f21e6d1965ULL;
   const uint64_t*      pos = (const uint64_t*)m_buf;
   const uint64_t*      end = pos + (len / 8);
@@ -55,13 +163,21 @@ static uint64_t fasthash64(const void* m_buf, size_t len, uint64_t seed) {
   uint64_t             v;
 
   while(pos != end) {
-    v = *pos++;
+    memcpy(&v, pos++, 8);
+    if(lower)
+      v = swar_lower(v);
     h ^= fasthash64_mix(v);
     h *= m;
   }
 
   pos2 = (const unsigned char*)pos;
   v    = 0;
+  unsigned char tail[8];
+  if(lower && (len & 7)) {
+    for(size_t i = 0; i < (len & 7); i++)
+      tail[i] = (unsigned char)ascii_lower((char)pos2[i]);
+    pos2 = tail;
+  }
 
   switch(len & 7) {
   case 7:
@@ -93,18 +209,119 @@ unsigned char log2i(unsigned x) {
   return r;
 }
 
-namespace internal {} // namespace internal
+namespace internal {
+class heap_allocator : public allocator {
+ public:
+  void* allocate(size_t n) override {
+    return malloc(n);
+  }
+
+  void* reallocate(void* ptr, size_t, size_t n) override {
+    return realloc(ptr, n);
+  }
+
+  void deallocate(void* ptr, size_t) override {
+    free(ptr);
+  }
+};
+
+static heap_allocator         g_heap;
+static thread_local allocator* t_current = nullptr;
+} // namespace internal
+
+void* allocator::reallocate(void* ptr, size_t old, size_t n) {
+  void* nptr = allocate(n);
+  if(!nptr)
+    return nullptr;
+  if(ptr) {
+    memcpy(nptr, ptr, std::min(old, n));
+    deallocate(ptr, old);
+  }
+  return nptr;
+}
+
+allocator& allocator::heap() {
+  return internal::g_heap;
+}
+
+allocator& allocator::current() {
+  if(internal::t_current)
+    return *internal::t_current;
+  return internal::g_heap;
+}
+
+allocator::scope::scope(allocator& alloc) : m_prev(internal::t_current) {
+  internal::t_current = &alloc;
+}
+
+allocator::scope::~scope() {
+  internal::t_current = m_prev;
+}
+
+/* Header in front of every shared string buffer. Aligned so the buffer stays 8
+ * byte aligned. */
+struct alignas(8) strhead {
+  std::atomic<uint32_t> refs;
+  // Size of the buffer, excluding header and null terminator
+  uint32_t              size;
+  allocator*            alloc;
+};
+
+static strhead* str_head(const char* buf) {
+  return (strhead*)(buf - sizeof(strhead));
+}
+
+/* Allocates a zeroed shared buffer of `size` bytes, plus null terminator.
+ * Buffers about to be filled completely can skip zeroing. */
+static char* str_alloc(unsigned size, bool zero = true) {
+  allocator& alloc = allocator::current();
+  char*      mem   = (char*)alloc.allocate(sizeof(strhead) + size + 1);
+  if(!mem)
+    throw "out of memory";
+  strhead* head = new(mem) strhead();
+  head->refs.store(1, std::memory_order_relaxed);
+  head->size  = size;
+  head->alloc = &alloc;
+  if(zero)
+    memset(mem + sizeof(strhead), 0, (size_t)size + 1);
+  else
+    mem[sizeof(strhead) + size] = 0;
+  return mem + sizeof(strhead);
+}
+
+static void str_retain(const char* buf) {
+  str_head(buf)->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void str_release(const char* buf) {
+  strhead* head = str_head(buf);
+  if(head->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    allocator* alloc = head->alloc;
+    size_t     size  = sizeof(strhead) + head->size + 1;
+    head->~strhead();
+    alloc->deallocate(head, size);
+  }
+}
 
 bool string::isview() const {
   return m_buf && !m_sz;
 }
 
 void string::make_unique() {
-  if(!isview() || !*this)
+  if(!*this)
+    return;
+  if(!isview() &&
+     (!m_shared || str_head(m_buf)->refs.load(std::memory_order_acquire) == 1))
     return;
-  char* buf = new char[m_ln + 1];
-  memcpy(buf, m_buf, (size_t)m_ln + 1);
-  m_sz = m_ln;
+  const unsigned ln  = m_ln;
+  const unsigned sz  = size();
+  char*          buf = str_alloc(sz);
+  memcpy(buf, m_buf, ln);
+  clear();
+  m_buf    = buf;
+  m_ln     = ln;
+  m_sz     = sz;
+  m_shared = true;
 }
 
 string::string() {
@@ -133,27 +350,30 @@ string::string(const wchar_t* wstr) {
 #endif
 
 string::string(const string& rhs) {
-  if(rhs) {
-    if(rhs.isview()) {
-      m_buf = rhs.m_buf;
-      m_ln  = rhs.m_ln;
-      m_sz  = rhs.m_sz;
-    } else {
-      m_sz  = rhs.size();
-      m_buf = new char[m_sz + 1];
-      memcpy(m_buf, rhs.m_buf, (size_t)m_sz + 1);
-      m_ln = rhs.m_ln;
-    }
-  }
+  *this = rhs;
+}
+
+string::string(string&& rhs) {
+  *this = std::move(rhs);
 }
 
 string::~string() {
-  if(!isview() && *this) {
-    delete[] m_buf;
-  }
+  clear();
 }
 
 string& string::operator=(const string& rhs) {
+  if(this == &rhs)
+    return *this;
+  if(rhs.m_shared && rhs.m_ln >= SCL_STRING_SHARE) {
+    // Share the buffer instead of copying it
+    str_retain(rhs.m_buf);
+    clear();
+    m_buf    = rhs.m_buf;
+    m_ln     = rhs.m_ln;
+    m_sz     = rhs.m_sz;
+    m_shared = true;
+    return *this;
+  }
   clear();
   if(rhs) {
     if(rhs.isview()) {
@@ -162,27 +382,52 @@ string& string::operator=(const string& rhs) {
       m_sz  = rhs.m_sz;
     } else {
       m_sz  = rhs.size();
-      m_buf = new char[m_sz + 1];
+      m_buf = str_alloc(m_sz);
       memcpy(m_buf, rhs.m_buf, (size_t)m_sz + 1);
-      m_ln = rhs.m_ln;
+      m_ln     = rhs.m_ln;
+      m_shared = true;
     }
   }
   return *this;
 }
 
+string& string::operator=(string&& rhs) {
+  if(this == &rhs)
+    return *this;
+  clear();
+  m_buf        = rhs.m_buf;
+  m_ln         = rhs.m_ln;
+  m_sz         = rhs.m_sz;
+  m_shared     = rhs.m_shared;
+
+  rhs.m_buf    = nullptr;
+  rhs.m_ln     = 0;
+  rhs.m_sz     = 0;
+  rhs.m_shared = false;
+  return *this;
+}
+
 void string::clear() {
-  if(!isview() && *this)
-    delete[] m_buf;
-  m_buf = nullptr;
-  m_ln  = 0;
-  m_sz  = 0;
+  if(!isview() && *this) {
+    if(m_shared)
+      str_release(m_buf);
+    else
+      delete[] m_buf;
+  }
+  m_buf    = nullptr;
+  m_ln     = 0;
+  m_sz     = 0;
+  m_shared = false;
 }
 
 string& string::claim(const char* ptr) {
-  clear();
-  m_buf = (char*)ptr;
-  m_ln  = ptr ? (unsigned)strlen(ptr) : 0;
-  m_sz  = m_ln;
+  if(!ptr) {
+    clear();
+    return *this;
+  }
+  const unsigned ln = (unsigned)strlen(ptr);
+  memcpy(alloc(ln), ptr, ln);
+  delete[] ptr;
   return *this;
 }
 
@@ -195,18 +440,28 @@ string& string::view(const char* ptr) {
 }
 
 string& string::reserve(unsigned size) {
-  char* nbuf = new char[size + 1];
-  if(!nbuf)
-    throw "out of stream";
-  memset(nbuf, 0, (size_t)size + 1);
+  const unsigned ln   = std::min(m_ln, size);
+  char*          nbuf = str_alloc(size);
   if(*this)
-    memcpy(nbuf, m_buf, m_sz);
-  claim(nbuf);
-  m_ln = (unsigned)len();
-  m_sz = size;
+    memcpy(nbuf, m_buf, ln);
+  clear();
+  m_buf    = nbuf;
+  m_ln     = (unsigned)strlen(nbuf);
+  m_sz     = size;
+  m_shared = true;
   return *this;
 }
 
+char* string::alloc(unsigned len) {
+  char* buf = str_alloc(len, false);
+  clear();
+  m_buf    = buf;
+  m_ln     = len;
+  m_sz     = len;
+  m_shared = true;
+  return buf;
+}
+
 const char* string::cstr() const {
   return m_buf;
 }
@@ -223,32 +478,17 @@ const wchar_t* string::wstr() const {
 }
 #endif
 
-#define _isHex(c) ((c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f'))
-#define _fromHex(c)                        \
-  ((c >= 'A' && c <= 'F') ? (c - 'A' + 10) \
-                          : ((c >= 'a' && c <= 'f') ? (c - 'a' + 10) : 0))
-
 long long string::toInt() const {
-  bool hex = false;
-  for(unsigned i = 0; i < len(); i++) {
-    char c = m_buf[i];
-    if(_isHex(c)) {
-      hex = true;
-      break;
-    }
-  }
   long long o = 0;
-  for(unsigned i = 0; i < len(); i++) {
-    char c = m_buf[i];
-    int  m = 0;
-    if((c >= '0' && c <= '9'))
-      m = c - '0';
-    else if(hex && _isHex(c))
-      m = _fromHex(c);
-    else
-      break;
-    o = o * (hex ? 16 : 10) + m;
-  }
+  if(m_buf)
+    from_chars(m_buf, m_buf + m_ln, o, 0);
+  return o;
+}
+
+double string::toFloat() const {
+  double o = 0.0;
+  if(m_buf)
+    from_chars(m_buf, m_buf + m_ln, o);
   return o;
 }
 
@@ -321,22 +561,30 @@ unsigned string::hash() const {
   return (unsigned)(h - (h >> 32));
 }
 
+unsigned string::ihash() const {
+  uint64_t h = fasthash64(m_buf, m_ln, 1024, true);
+  return (unsigned)(h - (h >> 32));
+}
+
+bool string::iequals(const string& rhs) const {
+  return m_ln == rhs.m_ln && ascii_iequals(m_buf, rhs.m_buf, m_ln);
+}
+
 string string::substr(unsigned i, unsigned j) const {
   if(!*this || i >= m_ln)
     return "";
-  j         = std::min(j, (unsigned)strlen(m_buf + i));
-  char* out = new char[j + 1];
-  if(!out)
-    throw "out of stream";
-  memset(out, 0, (size_t)j + 1);
-  memcpy(out, m_buf + i, j);
+  j = std::min(j, (unsigned)strlen(m_buf + i));
+  if(!j)
+    return "";
   string sout;
-  sout.claim(out);
-  return std::move(sout);
+  sout.reserve(j);
+  memcpy(sout.m_buf, m_buf + i, j);
+  sout.m_ln = j;
+  return sout;
 }
 
 string& string::replace(const string& pattern, const string& with) {
-  if(!*this || !pattern)
+  if(!*this || !pattern || ffi(pattern) < 0)
     return *this;
   const char* str = m_buf;
   string      out;
@@ -364,7 +612,7 @@ scl::string& string::replace(const scl::string& with, int i, int j) {
   int d  = size() - i - j;
   if(i + l + d > size())
     reserve(i + l + d);
-  else if(isview())
+  else
     make_unique();
   if(d)
     memcpy(m_buf + i + l, m_buf + i, d);
@@ -375,11 +623,14 @@ scl::string& string::replace(const scl::string& with, int i, int j) {
 }
 
 string& string::toUpper() {
-  for(auto& c : *this) {
-    if(c >= 'a' && c <= 'z') {
-      c -= 32;
-    }
-  }
+  make_unique();
+  ascii_case(m_buf, m_ln, 'a', 'z');
+  return *this;
+}
+
+string& string::toLower() {
+  make_unique();
+  ascii_case(m_buf, m_ln, 'A', 'Z');
   return *this;
 }
 
@@ -399,14 +650,13 @@ string string::substr(const char* str, unsigned i, unsigned j) {
   const unsigned m_ln = str ? (unsigned)strlen(str) : 0;
   if(!str || i >= m_ln)
     return "";
-  j         = std::min(j, (unsigned)strlen(str + i));
-  char* out = new char[j + 1];
-  if(!out)
-    throw "out of stream";
-  memset(out, 0, (size_t)j + 1);
-  memcpy(out, str + i, j);
+  j = std::min(j, (unsigned)strlen(str + i));
+  if(!j)
+    return "";
   string sout;
-  sout.claim(out);
+  sout.reserve(j);
+  memcpy(sout.m_buf, str + i, j);
+  sout.m_ln = j;
   return sout;
 }
 
@@ -427,18 +677,33 @@ string string::rand(unsigned len) {
   return str;
 }
 
+string string::fromInt(long long v, int base) {
+  char  buf[SCL_INT_CHARS + 1];
+  char* e = to_chars(buf, buf + SCL_INT_CHARS, v, base);
+  if(!e)
+    return "";
+  *e = '\0';
+  return string(buf).copy();
+}
+
+string string::fromFloat(double v) {
+  char  buf[SCL_FLOAT_CHARS + 1];
+  char* e = to_chars(buf, buf + SCL_FLOAT_CHARS, v);
+  *e      = '\0';
+  return string(buf).copy();
+}
+
 string string::vfmt(const char* fmt, va_list args) {
   va_list copy;
   va_copy(copy, args);
   int size = vsnprintf(nullptr, 0, fmt, copy) + 1;
   va_end(copy);
-  char* str = new char[size];
-  if(!str)
-    throw "out of stream";
-  memset(str, 0, size);
-  vsnprintf(str, size, fmt, args);
+  if(size <= 1)
+    return "";
   string out;
-  out.claim(str);
+  out.reserve(size - 1);
+  vsnprintf(out.m_buf, size, fmt, args);
+  out.m_ln = size - 1;
   return out;
 }
 
@@ -578,6 +843,241 @@ str_iterator& str_iterator::operator=(char c) {
 }
 } // namespace internal
 
+static bool slice_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+slice::slice(const char* str) : m_buf(str) {
+  m_ln = str ? (unsigned)strlen(str) : 0;
+}
+
+slice::slice(const char* str, unsigned len) : m_buf(str), m_ln(len) {
+}
+
+slice::slice(const string& str) : m_buf(str.cstr()), m_ln(str.len()) {
+}
+
+const char* slice::data() const {
+  return m_buf;
+}
+
+unsigned slice::len() const {
+  return m_ln;
+}
+
+slice slice::substr(unsigned i, unsigned j) const {
+  if(i >= m_ln)
+    return slice(m_buf + m_ln, 0);
+  return slice(m_buf + i, std::min(j, m_ln - i));
+}
+
+long long slice::ffi(const slice& pattern) const {
+  if(!pattern.m_ln || pattern.m_ln > m_ln)
+    return -1;
+  const char* p = m_buf;
+  const char* e = m_buf + m_ln - pattern.m_ln;
+  const char  c = pattern.m_buf[0];
+  while(p <= e) {
+    p = (const char*)memchr(p, c, (size_t)(e - p) + 1);
+    if(!p)
+      break;
+    if(!memcmp(p, pattern.m_buf, pattern.m_ln))
+      return (long long)(p - m_buf);
+    p++;
+  }
+  return -1;
+}
+
+long long slice::fli(const slice& pattern) const {
+  if(!pattern.m_ln || pattern.m_ln > m_ln)
+    return -1;
+  for(const char* p = m_buf + m_ln - pattern.m_ln; p >= m_buf; p--) {
+    if(*p == pattern.m_buf[0] && !memcmp(p, pattern.m_buf, pattern.m_ln))
+      return (long long)(p - m_buf);
+  }
+  return -1;
+}
+
+bool slice::startswith(const slice& pattern) const {
+  return pattern.m_ln <= m_ln && !memcmp(m_buf, pattern.m_buf, pattern.m_ln);
+}
+
+bool slice::endswith(const slice& pattern) const {
+  return pattern.m_ln <= m_ln &&
+         !memcmp(m_buf + m_ln - pattern.m_ln, pattern.m_buf, pattern.m_ln);
+}
+
+slice slice::trim() const {
+  return ltrim().rtrim();
+}
+
+slice slice::ltrim() const {
+  unsigned i = 0;
+  while(i < m_ln && slice_space(m_buf[i]))
+    i++;
+  return slice(m_buf + i, m_ln - i);
+}
+
+slice slice::rtrim() const {
+  unsigned l = m_ln;
+  while(l && slice_space(m_buf[l - 1]))
+    l--;
+  return slice(m_buf, l);
+}
+
+internal::slice_tokens slice::split(const slice& delim) const {
+  return internal::slice_tokens(*this, delim, false);
+}
+
+internal::slice_tokens slice::tokens(const slice& delims) const {
+  return internal::slice_tokens(*this, delims, true);
+}
+
+string slice::copy() const {
+  if(!m_ln)
+    return "";
+  string out;
+  out.reserve(m_ln);
+  memcpy(out.m_buf, m_buf, m_ln);
+  out.m_ln = m_ln;
+  return out;
+}
+
+long long slice::toInt() const {
+  long long o = 0;
+  if(m_buf)
+    from_chars(m_buf, m_buf + m_ln, o, 0);
+  return o;
+}
+
+double slice::toFloat() const {
+  double o = 0.0;
+  if(m_buf)
+    from_chars(m_buf, m_buf + m_ln, o);
+  return o;
+}
+
+unsigned slice::hash() const {
+  uint64_t h = fasthash64(m_buf, m_ln, 1024);
+  return (unsigned)(h - (h >> 32));
+}
+
+unsigned slice::ihash() const {
+  uint64_t h = fasthash64(m_buf, m_ln, 1024, true);
+  return (unsigned)(h - (h >> 32));
+}
+
+bool slice::iequals(const slice& rhs) const {
+  return m_ln == rhs.m_ln && ascii_iequals(m_buf, rhs.m_buf, m_ln);
+}
+
+const char* slice::begin() const {
+  return m_buf;
+}
+
+const char* slice::end() const {
+  return m_buf + m_ln;
+}
+
+char slice::operator[](unsigned i) const {
+  if(i >= m_ln)
+    throw std::out_of_range("");
+  return m_buf[i];
+}
+
+bool slice::operator==(const slice& rhs) const {
+  return m_ln == rhs.m_ln && !memcmp(m_buf, rhs.m_buf, m_ln);
+}
+
+bool slice::operator!=(const slice& rhs) const {
+  return !(*this == rhs);
+}
+
+bool slice::operator<(const slice& rhs) const {
+  int c = memcmp(m_buf, rhs.m_buf, std::min(m_ln, rhs.m_ln));
+  return c < 0 || (!c && m_ln < rhs.m_ln);
+}
+
+slice::operator bool() const {
+  return m_ln;
+}
+
+namespace internal {
+slice_iterator::slice_iterator(const slice& str, const slice& delim, bool any)
+    : m_delim(delim), m_any(any) {
+  if(str.len()) {
+    m_p = str.begin();
+    m_e = str.end();
+    next();
+  }
+}
+
+void slice_iterator::next() {
+  if(!m_p) {
+    m_tok = slice();
+    return;
+  }
+  const char* s = m_p;
+  if(m_any) {
+    const char* d = m_delim.data();
+    unsigned    n = m_delim.len();
+    while(s < m_e && memchr(d, *s, n))
+      s++;
+    if(s == m_e) {
+      m_p   = nullptr;
+      m_tok = slice();
+      return;
+    }
+    m_p = s;
+    while(m_p < m_e && !memchr(d, *m_p, n))
+      m_p++;
+    m_tok = slice(s, unsigned(m_p - s));
+    return;
+  }
+  long long f = slice(s, unsigned(m_e - s)).ffi(m_delim);
+  if(f < 0) {
+    m_tok = slice(s, unsigned(m_e - s));
+    m_p   = nullptr;
+  } else {
+    m_tok = slice(s, (unsigned)f);
+    m_p   = s + f + m_delim.len();
+  }
+}
+
+bool slice_iterator::operator==(const slice_iterator& rhs) const {
+  return m_tok.data() == rhs.m_tok.data() && m_p == rhs.m_p;
+}
+
+bool slice_iterator::operator!=(const slice_iterator& rhs) const {
+  return !(*this == rhs);
+}
+
+slice_iterator& slice_iterator::operator++() {
+  next();
+  return *this;
+}
+
+const slice& slice_iterator::operator*() const {
+  return m_tok;
+}
+
+const slice* slice_iterator::operator->() const {
+  return &m_tok;
+}
+
+slice_tokens::slice_tokens(const slice& str, const slice& delim, bool any)
+    : m_str(str), m_delim(delim), m_any(any) {
+}
+
+slice_iterator slice_tokens::begin() const {
+  return slice_iterator(m_str, m_delim, m_any);
+}
+
+slice_iterator slice_tokens::end() const {
+  return slice_iterator();
+}
+} // namespace internal
+
 #ifdef _WIN32
 /* Windows sleep in 100ns units */
 static BOOLEAN _nanosleep(LONGLONG ns) {
@@ -604,32 +1104,51 @@ static BOOLEAN _nanosleep(LONGLONG ns) {
   /* Slept without problems */
   return TRUE;
 }
-
-static LARGE_INTEGER base_clock = {0};
-#else
-static double base_clock = 0.0;
 #endif
 
+static uint64_t base_clock = 0;
+
 void resetclock() {
-#ifdef _WIN32
-  QueryPerformanceCounter(&base_clock);
-#else
-  base_clock = clock();
-#endif
+  base_clock = nanos();
 }
 
 double clock() {
+  return (double)(nanos() - base_clock) / 1e9;
+}
+
+uint64_t nanos() {
 #if defined(_WIN32)
   LARGE_INTEGER pc;
   LARGE_INTEGER pf;
   QueryPerformanceCounter(&pc);
   QueryPerformanceFrequency(&pf);
-  return (double)(pc.QuadPart - base_clock.QuadPart) / (double)pf.QuadPart;
-#elif defined(__unix__) || defined(__APPLE__)
+  // Split, so the multiplication does not overflow
+  uint64_t f = (uint64_t)pf.QuadPart;
+  uint64_t c = (uint64_t)pc.QuadPart;
+  return c / f * 1000000000ULL + c % f * 1000000000ULL / f;
+#else
+  // Unlike timespec_get(), not moved by NTP or the user setting the time
   struct timespec ts;
-  timespec_get(&ts, 1);
-  return ((double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0) - base_clock;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+double cyclerate() {
+  static const double rate = []() {
+#ifdef SCL_RDTSC
+    uint64_t n0 = nanos();
+    uint64_t c0 = cycles();
+    waitms(10);
+    uint64_t n1 = nanos();
+    uint64_t c1 = cycles();
+    return (double)(c1 - c0) * 1e9 / (double)(n1 - n0);
+#else
+    // cycles() is nanos()
+    return 1e9;
 #endif
+  }();
+  return rate;
 }
 
 void waitms(double ms) {
@@ -637,7 +1156,7 @@ void waitms(double ms) {
   struct timespec ts = {2000, 0};
   ts.tv_sec          = ms / 1000.0;
 
-  ts.tv_nsec         = fmodf(ms, 1000) * 1000000.0;
+  ts.tv_nsec         = fmod(ms, 1000) * 1000000.0;
   while(nanosleep(&ts, &ts) == -1)
     ;
 #elif defined(_WIN32)
@@ -658,69 +1177,213 @@ void waitms(double ms) {
 }
 
 bool waitUntil(std::function<bool()> cond, double timeout, double sleepms) {
-  bool   infinite = timeout == -1;
-  double cs       = scl::clock();
-  double ce;
-  bool   timedout = false;
+  bool     infinite = timeout < 0;
+  uint64_t limit    = infinite ? 0 : (uint64_t)(timeout * 1e9);
+  uint64_t cs       = nanos();
+  bool     timedout = false;
   while(!cond() && !timedout) {
     scl::waitms(sleepms);
-    ce       = scl::clock();
-    timedout = ((ce - cs) > timeout && !infinite);
+    timedout = !infinite && nanos() - cs > limit;
   }
   return !timedout;
 }
 
+stream::stream(allocator& alloc) : m_alloc(&alloc) {
+}
+
 stream::stream(stream&& rhs) {
   m_stream       = rhs.m_stream;
   m_data         = rhs.m_data;
   m_fp           = rhs.m_fp;
   m_size         = rhs.m_size;
+  m_cap          = rhs.m_cap;
+  m_alloc        = rhs.m_alloc;
   m_ronly        = rhs.m_ronly;
+  m_wonly        = rhs.m_wonly;
   m_modified     = rhs.m_modified;
+  m_mapped       = rhs.m_mapped;
+  m_dir          = rhs.m_dir;
+  m_bufsz        = rhs.m_bufsz;
+  m_direct       = rhs.m_direct;
+  m_failed       = rhs.m_failed;
+  m_line         = rhs.m_line;
+  m_linecap      = rhs.m_linecap;
 
   rhs.m_stream   = 0;
   rhs.m_data     = 0;
   rhs.m_fp       = 0;
   rhs.m_size     = 0;
+  rhs.m_cap      = 0;
   rhs.m_ronly    = 0;
+  rhs.m_wonly    = 0;
   rhs.m_modified = 0;
+  rhs.m_mapped   = 0;
+  rhs.m_dir      = DIR_NONE;
+  rhs.m_direct   = nullptr;
+  rhs.m_failed   = false;
+  rhs.m_line     = nullptr;
+  rhs.m_linecap  = 0;
 }
 
 stream& stream::operator=(stream&& rhs) {
+  close_internal();
   m_stream       = rhs.m_stream;
   m_data         = rhs.m_data;
   m_fp           = rhs.m_fp;
   m_size         = rhs.m_size;
+  m_cap          = rhs.m_cap;
+  m_alloc        = rhs.m_alloc;
   m_ronly        = rhs.m_ronly;
+  m_wonly        = rhs.m_wonly;
   m_modified     = rhs.m_modified;
+  m_mapped       = rhs.m_mapped;
+  m_dir          = rhs.m_dir;
+  m_bufsz        = rhs.m_bufsz;
+  m_direct       = rhs.m_direct;
+  m_failed       = rhs.m_failed;
+  m_line         = rhs.m_line;
+  m_linecap      = rhs.m_linecap;
 
   rhs.m_stream   = 0;
   rhs.m_data     = 0;
   rhs.m_fp       = 0;
   rhs.m_size     = 0;
+  rhs.m_cap      = 0;
   rhs.m_ronly    = 0;
+  rhs.m_wonly    = 0;
   rhs.m_modified = 0;
+  rhs.m_mapped   = 0;
+  rhs.m_dir      = DIR_NONE;
+  rhs.m_direct   = nullptr;
+  rhs.m_failed   = false;
+  rhs.m_line     = nullptr;
+  rhs.m_linecap  = 0;
   return *this;
 }
 
+bool stream::map(const scl::path& path) {
+  if(m_stream || m_data)
+    return false;
+  void* map = nullptr;
+  size_t size;
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.cstr(), GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER fsize;
+  if(!GetFileSizeEx(file, &fsize) ||
+     (unsigned long long)fsize.QuadPart > SIZE_MAX) {
+    CloseHandle(file);
+    return false;
+  }
+  size = (size_t)fsize.QuadPart;
+  if(size) {
+    // The view keeps the mapping alive, so both handles can be closed
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping) {
+      map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+    if(!map) {
+      CloseHandle(file);
+      return false;
+    }
+  }
+  CloseHandle(file);
+#else
+  int fd = ::open(path.cstr(), O_RDONLY);
+  if(fd == -1)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) == -1 || (unsigned long long)st.st_size > SIZE_MAX) {
+    ::close(fd);
+    return false;
+  }
+  size = (size_t)st.st_size;
+  if(size) {
+    map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+  }
+  // The mapping holds its own reference to the file
+  ::close(fd);
+#endif
+  m_data   = (char*)map;
+  m_fp     = m_data;
+  m_size   = size;
+  m_cap    = size;
+  m_ronly  = true;
+  m_mapped = true;
+  return true;
+}
+
+void stream::unmap() {
+  if(m_data) {
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap(m_data, m_size);
+#endif
+  }
+  m_data   = nullptr;
+  m_mapped = false;
+}
+
 void stream::close_internal() {
+  direct_end();
   flush();
   if(m_stream)
     fclose(m_stream);
-  if(m_data)
-    delete[] m_data;
+  if(m_mapped)
+    unmap();
+  else if(m_data)
+    m_alloc->deallocate(m_data, m_cap);
+  // Allocated with malloc(), by getdelim()
+  free(m_line);
+  m_line     = nullptr;
+  m_linecap  = 0;
   m_stream   = 0;
   m_data     = 0;
   m_fp       = 0;
   m_size     = 0;
+  m_cap      = 0;
   m_ronly    = 0;
+  m_wonly    = 0;
   m_modified = 0;
+  m_dir      = DIR_NONE;
+}
+
+void stream::direction(int dir) {
+  // Switching between reading and writing requires a flush or a seek, so only
+  // pay for it when the direction actually changes.
+  if(m_dir != DIR_NONE && m_dir != dir)
+    fseek(m_stream, 0, SEEK_CUR);
+  m_dir = (decltype(m_dir))dir;
 }
 
 stream::~stream() {
   close_internal();
 }
 
+static int file_seek(FILE* f, long long off, int origin) {
+#ifdef _WIN32
+  return _fseeki64(f, off, origin);
+#else
+  return fseeko(f, (off_t)off, origin);
+#endif
+}
+
+static long long file_tell(FILE* f) {
+#ifdef _WIN32
+  return _ftelli64(f);
+#else
+  return ftello(f);
+#endif
+}
+
 long long stream::bounds(const char* p, size_t n) const {
   if(p >= m_data + m_size)
     return 0;
@@ -729,6 +1392,7 @@ long long stream::bounds(const char* p, size_t n) const {
 
 long long stream::read_internal(void* buf, size_t n) {
   if(m_stream) {
+    direct_end();
     if(n == (size_t)-1) {
       auto o = tell();
       seek(StreamPos::end, 0);
@@ -736,12 +1400,10 @@ long long stream::read_internal(void* buf, size_t n) {
       seek(StreamPos::start, o);
       n = std::min(n, (size_t)l);
     }
+    direction(DIR_READ);
     if(feof(m_stream))
       return 0;
-    auto r = fread(buf, 1, n, m_stream);
-    // Suggested by gnu.org, cause r+/w+ modes are weird
-    fflush(m_stream);
-    return r;
+    return fread(buf, 1, n, m_stream);
   }
   size_t r = bounds(m_fp, n);
   if(!r)
@@ -753,38 +1415,232 @@ long long stream::read_internal(void* buf, size_t n) {
 
 #define alignup(x, align) ((((x) + ((align) - 1)) / (align)) * align)
 
+namespace internal {
+/* Appends of an OpenMode::DIRECT stream. Data is gathered into one of two
+ * aligned buffers, while the other one is written to an O_DIRECT descriptor
+ * of the same file by a background thread. */
+struct direct_writer {
+  // Alignment O_DIRECT wants for buffers, offsets and lengths
+  static const size_t     kAlign = 4096;
+  static const size_t     kSize  = alignup(SCL_DIRECT_BUF, kAlign);
+
+  int                     fd      = -1;
+  char*                   bufs[2] = {nullptr, nullptr};
+  int                     cur     = 0;
+  size_t                  fill    = 0;
+  // File offset of bufs[cur]
+  long long               base    = 0;
+  std::thread             thread;
+  std::mutex              mux;
+  std::condition_variable cv;
+  // Buffer being written out by the thread
+  char*                   job    = nullptr;
+  size_t                  joblen = 0;
+  long long               joboff = 0;
+  bool                    stop   = false;
+  bool                    failed = false;
+
+  static direct_writer*   open(const scl::path& path);
+  ~direct_writer();
+
+  bool                    write(const void* buf, size_t n);
+  bool                    submit(size_t n);
+  bool                    sync();
+  long long               finish();
+  void                    run();
+};
+
+direct_writer* direct_writer::open(const scl::path& path) {
+#ifdef O_DIRECT
+  // Not every file system takes O_DIRECT, tmpfs for one
+  int fd = ::open(path.cstr(), O_WRONLY | O_DIRECT);
+  if(fd == -1)
+    return nullptr;
+  direct_writer* w = new direct_writer();
+  w->fd            = fd;
+  for(char*& b : w->bufs) {
+    if(posix_memalign((void**)&b, kAlign, kSize)) {
+      delete w;
+      return nullptr;
+    }
+  }
+  w->thread = std::thread(&direct_writer::run, w);
+  return w;
+#else
+  return nullptr;
+#endif
+}
+
+direct_writer::~direct_writer() {
+  if(thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mux);
+      stop = true;
+    }
+    cv.notify_all();
+    thread.join();
+  }
+#ifndef _WIN32
+  if(fd != -1)
+    ::close(fd);
+#endif
+  free(bufs[0]);
+  free(bufs[1]);
+}
+
+void direct_writer::run() {
+  std::unique_lock<std::mutex> lock(mux);
+  for(;;) {
+    cv.wait(lock, [this]() { return job || stop; });
+    if(!job)
+      return;
+    char*     buf = job;
+    size_t    n   = joblen;
+    long long off = joboff;
+    lock.unlock();
+    size_t w = 0;
+#ifndef _WIN32
+    while(w < n) {
+      ssize_t r = pwrite(fd, buf + w, n - w, off + w);
+      if(r < 0 && errno == EINTR)
+        continue;
+      if(r <= 0)
+        break;
+      w += r;
+    }
+#endif
+    lock.lock();
+    failed = failed || w != n;
+    job    = nullptr;
+    cv.notify_all();
+  }
+}
+
+/* Hands the current buffer to the thread, once it is done with the other one,
+ * and switches buffers. `n` is the number of bytes to write, aligned. */
+bool direct_writer::submit(size_t n) {
+  std::unique_lock<std::mutex> lock(mux);
+  cv.wait(lock, [this]() { return !job; });
+  if(failed)
+    return false;
+  job    = bufs[cur];
+  joblen = n;
+  joboff = base;
+  cv.notify_all();
+  base += fill;
+  fill  = 0;
+  cur  ^= 1;
+  return true;
+}
+
+bool direct_writer::write(const void* buf, size_t n) {
+  const char* p = (const char*)buf;
+  while(n) {
+    size_t c = std::min(n, kSize - fill);
+    memcpy(bufs[cur] + fill, p, c);
+    fill += c;
+    p += c;
+    n -= c;
+    if(fill == kSize && !submit(fill))
+      return false;
+  }
+  return true;
+}
+
+bool direct_writer::sync() {
+  std::unique_lock<std::mutex> lock(mux);
+  cv.wait(lock, [this]() { return !job; });
+  return !failed;
+}
+
+/* Writes out everything, padding the last block. Returns the number of bytes
+ * appended in total, or -1 if a write failed. */
+long long direct_writer::finish() {
+  long long end = base + fill;
+  bool      r   = true;
+  if(fill) {
+    size_t n = alignup(fill, kAlign);
+    memset(bufs[cur] + fill, 0, n - fill);
+    r = submit(n);
+  }
+  return sync() && r ? end : -1;
+}
+} // namespace internal
+
+void stream::direct_end() {
+  if(!m_direct)
+    return;
+  long long end = m_direct->finish();
+  delete m_direct;
+  m_direct = nullptr;
+#ifndef _WIN32
+  // Drop the padding of the last block
+  if(end >= 0 && ftruncate(fileno(m_stream), end) == -1)
+    end = -1;
+#endif
+  if(end >= 0)
+    file_seek(m_stream, end, SEEK_SET);
+  else
+    m_failed = true;
+  m_dir = DIR_NONE;
+}
+
 bool stream::write_internal(const void* buf, size_t n, size_t align) {
   if(!buf)
     return false;
   if(m_stream) {
-    size_t wr = fwrite(buf, 1, n, m_stream);
-    bool   r  = !n || wr;
-    // Suggested by gnu.org, cause r+/w+ modes are weird
-    fflush(m_stream);
-    return r;
+    if(m_failed)
+      return false;
+    if(m_direct)
+      return m_direct->write(buf, n);
+    direction(DIR_WRITE);
+    return fwrite(buf, 1, n, m_stream) == n;
   }
-  if(n > (m_size - (m_fp - m_data))) {
-    size_t res = alignup(m_size + n, align) - m_size;
+  size_t foff = m_fp - m_data;
+  if(n > m_cap - std::min(foff, m_cap)) {
+    // align only rounds up the requested space, reserve() takes care of
+    // growing geometrically
+    size_t res = alignup(foff + n, align) - foff;
     if(!reserve(res))
       return false;
   }
+  // Zero the gap left by seeking past the end
+  if(foff > m_size)
+    memset(m_data + m_size, 0, foff - m_size);
   memcpy(m_fp, buf, n);
-  m_fp       = std::min(m_fp + n, m_data + m_size);
+  m_fp       += n;
+  m_size     = std::max(m_size, foff + n);
   m_modified = true;
   return true;
 }
 
 bool stream::is_open() const {
-  return m_stream;
+  return m_stream || m_mapped;
+}
+
+int stream::fd() const {
+  if(!m_stream)
+    return -1;
+#ifdef _WIN32
+  return _fileno(m_stream);
+#else
+  return fileno(m_stream);
+#endif
 }
 
 bool stream::is_modified() const {
   return m_modified;
 }
 
+bool stream::failed() const {
+  return m_failed;
+}
+
 long long stream::tell() const {
+  if(m_direct)
+    return m_direct->base + m_direct->fill;
   if(m_stream) {
-    return ftell(m_stream);
+    return file_tell(m_stream);
   }
   return m_fp - m_data;
 }
@@ -800,14 +1656,17 @@ void stream::reset_modified() {
 }
 
 bool stream::openMode(const scl::path& path, const scl::string& mode) {
-  if(m_stream)
+  if(m_stream || m_mapped)
     return false;
-  m_ronly = mode == "r" || mode == "rb" || m_ronly;
+  m_failed = false;
+  m_ronly  = mode == "r" || mode == "rb" || m_ronly;
   m_wonly = mode == "w" || mode == "wb" || mode == "a" || m_wonly;
 #ifdef _MSC_VER
 #  pragma warning(disable : 4996)
 #endif
   m_stream = fopen(path.cstr(), mode.cstr());
+  if(m_stream)
+    setvbuf(m_stream, nullptr, m_bufsz ? _IOFBF : _IONBF, m_bufsz);
   if(m_data && m_stream)
     flush();
   return m_stream;
@@ -816,6 +1675,14 @@ bool stream::openMode(const scl::path& path, const scl::string& mode) {
 bool stream::open(const scl::path& path, OpenMode mode, bool binary) {
   // w+ creates the file, and truncates, and allows fseek to read and write.
   // r+ doesnt truncate the file, and allows fseek to read and write.
+  if(mode == OpenMode::MAP)
+    return map(path);
+  if(mode == OpenMode::DIRECT) {
+    if(!openMode(path, "w+b"))
+      return false;
+    m_direct = internal::direct_writer::open(path);
+    return true;
+  }
   scl::string smode;
   switch(mode) {
   case OpenMode::READ:
@@ -836,28 +1703,46 @@ bool stream::open(const scl::path& path, OpenMode mode, bool binary) {
   case OpenMode::RAPPEND:
     smode = "a+";
     break;
+  default:
+    return false;
   }
   if(binary)
     smode = smode.substr(0, 1) + "b" + smode.substr(1);
   return openMode(path, smode);
 }
 
+bool stream::buffer(size_t n) {
+  if(m_stream)
+    return false;
+  m_bufsz = n;
+  return true;
+}
+
 void stream::flush() {
   if(m_data && m_stream) {
     write_internal(m_data, m_size, 1);
-    delete[] m_data;
+    m_alloc->deallocate(m_data, m_cap);
     m_data = nullptr;
     m_fp   = nullptr;
     m_size = 0;
+    m_cap  = 0;
   }
+  // Waits for the background write, the last partial block stays buffered
+  if(m_direct && !m_direct->sync())
+    m_failed = true;
   if(m_stream)
     fflush(m_stream);
+  m_dir = DIR_NONE;
 }
 
 long long stream::seek(StreamPos pos, long long off) {
   if(m_stream) {
-    fseek(m_stream, (long)off, (int)pos);
-    return ftell(m_stream);
+    direct_end();
+    if(m_failed)
+      return -1;
+    m_dir = DIR_NONE;
+    file_seek(m_stream, off, (int)pos);
+    return file_tell(m_stream);
   }
   if(pos == StreamPos::start)
     m_fp = m_data;
@@ -874,53 +1759,586 @@ long long stream::read(void* buf, size_t n) {
   return read_internal(buf, n);
 }
 
+bool stream::read_until(scl::slice& out, char delim) {
+  if(m_wonly)
+    return false;
+  if(!m_stream && passthrough()) {
+    const char* end = m_data + m_size;
+    if(m_fp >= end)
+      return false;
+    const char* d = (const char*)memchr(m_fp, delim, end - m_fp);
+    if(!d)
+      d = end;
+    size_t len = std::min((size_t)(d - m_fp), (size_t)UINT_MAX);
+    out        = slice(m_fp, (unsigned)len);
+    m_fp       = (char*)(d < end ? d + 1 : d);
+    return true;
+  }
+  size_t n = 0;
+  if(m_stream && passthrough()) {
+    direct_end();
+    direction(DIR_READ);
+#ifndef _WIN32
+    // getdelim() searches stdio's buffer with memchr()
+    ssize_t r = getdelim(&m_line, &m_linecap, delim, m_stream);
+    if(r <= 0)
+      return false;
+    n   = r - (m_line[r - 1] == delim);
+    out = slice(m_line, (unsigned)std::min(n, (size_t)UINT_MAX));
+    return true;
+#endif
+  }
+  // One byte at a time, so nothing past the delimiter is consumed
+  char c;
+  bool any = false;
+  while(read(&c, 1) == 1) {
+    any = true;
+    if(c == delim)
+      break;
+    if(n + 1 >= m_linecap) {
+      size_t cap  = std::max((size_t)256, m_linecap * 2);
+      char*  line = (char*)realloc(m_line, cap);
+      if(!line)
+        return false;
+      m_line    = line;
+      m_linecap = cap;
+    }
+    m_line[n++] = c;
+  }
+  out = slice(m_line, (unsigned)std::min(n, (size_t)UINT_MAX));
+  return any;
+}
+
+bool stream::readline(scl::slice& out) {
+  if(!read_until(out, '\n'))
+    return false;
+  if(out.len() && out.data()[out.len() - 1] == '\r')
+    out = slice(out.data(), out.len() - 1);
+  return true;
+}
+
+bool stream::read_all(scl::string& out, size_t max) {
+  if(m_wonly)
+    return false;
+  if(!passthrough()) {
+    // Length unknown (a pipe has no end until its producers are done), so
+    // gather into memory first
+    stream tmp;
+    if(!tmp.write(*this, max))
+      return false;
+    tmp.seek(StreamPos::start, 0);
+    return tmp.read_all(out);
+  }
+  size_t n;
+  if(m_stream) {
+    direct_end();
+    direction(DIR_READ);
+    long long cur = file_tell(m_stream);
+#ifdef _WIN32
+    long long end = _filelengthi64(_fileno(m_stream));
+#else
+    struct stat st;
+    long long   end = fstat(fileno(m_stream), &st) == -1 ? -1 : st.st_size;
+#endif
+    if(cur < 0 || end < 0)
+      return false;
+    n = end > cur ? (size_t)(end - cur) : 0;
+  } else
+    n = (size_t)bounds(m_fp, max);
+  n = std::min(n, max);
+  if(n >= UINT_MAX)
+    return false;
+  out.clear();
+  if(!n)
+    return true;
+  char*     buf = str_alloc((unsigned)n, false);
+  // fread() of more than its buffer goes straight to read() into buf
+  long long r   = read_internal(buf, n);
+  buf[r]        = 0;
+  out.m_buf     = buf;
+  out.m_ln      = (unsigned)r;
+  out.m_sz      = (unsigned)n;
+  out.m_shared  = true;
+  return true;
+}
+
+long long stream::read_at(long long off, void* buf, size_t n) {
+  if(m_wonly || off < 0)
+    return 0;
+  if(!m_stream) {
+    if((size_t)off >= m_size)
+      return 0;
+    size_t r = std::min(n, m_size - (size_t)off);
+    memcpy(buf, m_data + off, r);
+    return r;
+  }
+  direct_end();
+  // Buffered writes have to reach the file first
+  if(m_dir == DIR_WRITE) {
+    fflush(m_stream);
+    m_dir = DIR_NONE;
+  }
+  size_t r = 0;
+#ifdef _WIN32
+  HANDLE h = (HANDLE)_get_osfhandle(_fileno(m_stream));
+  while(r < n) {
+    OVERLAPPED ov = {};
+    ov.Offset     = (DWORD)(off + r);
+    ov.OffsetHigh = (DWORD)((off + r) >> 32);
+    DWORD rd;
+    if(!ReadFile(h, (char*)buf + r, (DWORD)std::min(n - r, (size_t)UINT_MAX),
+         &rd, &ov) ||
+       !rd)
+      break;
+    r += rd;
+  }
+#else
+  int fd = fileno(m_stream);
+  while(r < n) {
+    ssize_t rd = pread(fd, (char*)buf + r, n - r, off + r);
+    if(rd <= 0)
+      break;
+    r += rd;
+  }
+#endif
+  return r;
+}
+
+bool stream::write_at(long long off, const void* buf, size_t n) {
+  if(m_ronly || off < 0 || !buf)
+    return false;
+  if(!m_stream) {
+    if(off + n > m_cap) {
+      // reserve() grows from the rw pointer, so point it at the start
+      long long foff = m_fp - m_data;
+      m_fp           = m_data;
+      bool r         = reserve(off + n);
+      m_fp           = m_data + foff;
+      if(!r)
+        return false;
+    }
+    if((size_t)off > m_size)
+      memset(m_data + m_size, 0, off - m_size);
+    memcpy(m_data + off, buf, n);
+    m_size     = std::max(m_size, (size_t)off + n);
+    m_modified = true;
+    return true;
+  }
+  direct_end();
+  // Write out pending data, and drop read ahead that could go stale
+  if(m_dir != DIR_NONE) {
+    fseek(m_stream, 0, SEEK_CUR);
+    m_dir = DIR_NONE;
+  }
+  size_t w = 0;
+#ifdef _WIN32
+  HANDLE h = (HANDLE)_get_osfhandle(_fileno(m_stream));
+  while(w < n) {
+    OVERLAPPED ov = {};
+    ov.Offset     = (DWORD)(off + w);
+    ov.OffsetHigh = (DWORD)((off + w) >> 32);
+    DWORD wr;
+    if(!WriteFile(h, (const char*)buf + w,
+         (DWORD)std::min(n - w, (size_t)UINT_MAX), &wr, &ov) ||
+       !wr)
+      break;
+    w += wr;
+  }
+#else
+  int fd = fileno(m_stream);
+  while(w < n) {
+    ssize_t wr = pwrite(fd, (const char*)buf + w, n - w, off + w);
+    if(wr <= 0)
+      break;
+    w += wr;
+  }
+#endif
+  return w == n;
+}
+
+bool stream::advise(Advice advice, long long off, size_t len) {
+  if(off < 0)
+    return false;
+#ifndef _WIN32
+  if(m_mapped) {
+    if(!m_data || (size_t)off >= m_size)
+      return false;
+    // madvise() wants a page aligned start
+    size_t page  = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (size_t)off / page * page;
+    size_t end   = len ? std::min(m_size, (size_t)off + len) : m_size;
+    int    adv   = MADV_NORMAL;
+    switch(advice) {
+    case Advice::SEQUENTIAL:
+      adv = MADV_SEQUENTIAL;
+      break;
+    case Advice::RANDOM:
+      adv = MADV_RANDOM;
+      break;
+    case Advice::WILLNEED:
+      adv = MADV_WILLNEED;
+      break;
+    case Advice::DONTNEED:
+      adv = MADV_DONTNEED;
+      break;
+    default:
+      break;
+    }
+    return !madvise(m_data + start, end - start, adv);
+  }
+#  ifdef POSIX_FADV_NORMAL
+  if(m_stream) {
+    int adv = POSIX_FADV_NORMAL;
+    switch(advice) {
+    case Advice::SEQUENTIAL:
+      adv = POSIX_FADV_SEQUENTIAL;
+      break;
+    case Advice::RANDOM:
+      adv = POSIX_FADV_RANDOM;
+      break;
+    case Advice::WILLNEED:
+      adv = POSIX_FADV_WILLNEED;
+      break;
+    case Advice::DONTNEED:
+      adv = POSIX_FADV_DONTNEED;
+      break;
+    default:
+      break;
+    }
+    return !posix_fadvise(fileno(m_stream), (off_t)off, (off_t)len, adv);
+  }
+#  endif
+#endif
+  return false;
+}
+
+bool stream::prefetch(long long off, size_t len) {
+  return advise(Advice::WILLNEED, off, len);
+}
+
+#ifndef _WIN32
+// Max number of iovecs passed to one readv()/writev() call
+static const int kIovBatch = 64;
+
+/* Runs readv() or writev() over all of `bufs`, in batches. Returns the number
+ * of bytes transferred. The caller must resync the FILE position after. */
+template <class F>
+static size_t fd_vector(const iobuf* bufs, size_t n, F&& op) {
+  size_t total = 0;
+  for(size_t i = 0; i < n;) {
+    struct iovec iov[kIovBatch];
+    size_t       want = 0;
+    int          c    = 0;
+    for(; c < kIovBatch && i < n; i++) {
+      if(!bufs[i].len)
+        continue;
+      iov[c].iov_base = bufs[i].data;
+      iov[c].iov_len  = bufs[i].len;
+      want += bufs[i].len;
+      c++;
+    }
+    if(!c)
+      break;
+    ssize_t r = op(iov, c);
+    if(r <= 0)
+      break;
+    total += r;
+    if((size_t)r < want)
+      break;
+  }
+  return total;
+}
+#endif
+
+long long stream::readv(const iobuf* bufs, size_t n) {
+  if(m_wonly)
+    return 0;
+  // Derived streams may transform data, so go through read()
+  if(!passthrough()) {
+    long long r = 0;
+    for(size_t i = 0; i < n; i++) {
+      long long rd = bufs[i].len ? read(bufs[i].data, bufs[i].len) : 0;
+      r += rd;
+      if(rd < (long long)bufs[i].len)
+        break;
+    }
+    return r;
+  }
+#ifndef _WIN32
+  size_t total = 0;
+  for(size_t i = 0; i < n; i++)
+    total += bufs[i].len;
+  // Too big for the stdio buffer, so go straight to the file. fflush() moves
+  // the file offset back to the stream position, dropping read ahead.
+  if(m_stream && total > m_bufsz) {
+    direct_end();
+    fflush(m_stream);
+    m_dir    = DIR_NONE;
+    int fd   = fileno(m_stream);
+    size_t r = fd_vector(bufs, n,
+      [fd](struct iovec* iov, int c) { return ::readv(fd, iov, c); });
+    file_seek(m_stream, lseek(fd, 0, SEEK_CUR), SEEK_SET);
+    return r;
+  }
+#endif
+  long long r = 0;
+  for(size_t i = 0; i < n; i++) {
+    if(!bufs[i].len)
+      continue;
+    long long rd = read_internal(bufs[i].data, bufs[i].len);
+    r += rd;
+    if(rd < (long long)bufs[i].len)
+      break;
+  }
+  return r;
+}
+
+bool stream::writev(const iobuf* bufs, size_t n, size_t align) {
+  if(m_ronly)
+    return false;
+  if(!passthrough()) {
+    for(size_t i = 0; i < n; i++) {
+      if(bufs[i].len && !write(bufs[i].data, bufs[i].len, align))
+        return false;
+    }
+    return true;
+  }
+  size_t total = 0;
+  for(size_t i = 0; i < n; i++)
+    total += bufs[i].len;
+  if(!m_stream) {
+    // One reservation for all buffers
+    size_t foff = m_fp - m_data;
+    if(total > m_cap - std::min(foff, m_cap) &&
+       !reserve(alignup(foff + total, align) - foff))
+      return false;
+  }
+#ifndef _WIN32
+  // Direct appends are gathered by write_internal() instead
+  else if(m_stream && total > m_bufsz && !m_direct) {
+    fflush(m_stream);
+    m_dir    = DIR_NONE;
+    int fd   = fileno(m_stream);
+    size_t w = fd_vector(bufs, n,
+      [fd](struct iovec* iov, int c) { return ::writev(fd, iov, c); });
+    file_seek(m_stream, lseek(fd, 0, SEEK_CUR), SEEK_SET);
+    return w == total;
+  }
+#endif
+  for(size_t i = 0; i < n; i++) {
+    if(bufs[i].len && !write_internal(bufs[i].data, bufs[i].len, align))
+      return false;
+  }
+  return true;
+}
+
 bool stream::reserve(size_t n, bool force) {
   // Ignore file mode
   if(m_stream)
     return true;
-  // Remaining length
-  long long rl = (m_data + m_size) - m_fp;
-  if(rl < (long long)n || force) {
-    size_t    nsz  = m_size + n;
-    long long foff = m_fp - m_data;
-
-    char*     buf  = new char[nsz];
-    if(!buf)
-      return false;
-    if(m_data) {
-      memcpy(buf, m_data, m_size);
-      delete[] m_data;
-    }
-    memset(buf + m_size, 0, nsz - m_size);
-    m_fp   = buf + foff;
-    m_data = buf;
-    m_size = nsz;
+  // Mappings are read only
+  if(m_mapped)
+    return false;
+  size_t foff = m_fp - m_data;
+  // size_t overflow
+  if(n > SIZE_MAX - (force ? m_cap : foff))
+    return false;
+  size_t need = force ? m_cap + n : foff + n;
+  if(need <= m_cap)
+    return true;
+  // Grow by at least half the capacity, so many small writes stay amortized
+  // O(1). The heap allocator uses realloc(), which can often grow in place,
+  // and uses mremap() for large blocks on Linux.
+  size_t ncap = std::max(need, m_cap + m_cap / 2);
+  char*  buf  = (char*)m_alloc->reallocate(m_data, m_cap, ncap);
+  if(!buf) {
+    buf  = (char*)m_alloc->reallocate(m_data, m_cap, need);
+    ncap = need;
   }
+  if(!buf)
+    return false;
+  m_fp   = buf + foff;
+  m_data = buf;
+  m_cap  = ncap;
   return true;
 }
 
 bool stream::write(const void* buf, size_t n, size_t align, bool flush) {
   if(m_ronly)
     return false;
-  // Just ignore flush?
-  return write_internal(buf, n, align);
+  bool r = write_internal(buf, n, align);
+  if(r && flush)
+    this->flush();
+  return r;
 }
 
 bool stream::write(const scl::string& str, size_t align, bool flush) {
   return write(str.cstr(), str.len(), align, flush);
 }
 
+bool stream::write_varint(unsigned long long v) {
+  uint8_t buf[10];
+  size_t  n = 0;
+  // 7 bits per byte, low bits first. The high bit marks more bytes to come.
+  do {
+    buf[n] = v & 0x7f;
+    v >>= 7;
+    if(v)
+      buf[n] |= 0x80;
+    n++;
+  } while(v);
+  return write(buf, n);
+}
+
+bool stream::read_varint(unsigned long long& v) {
+  unsigned long long r = 0;
+  // Memory mode decodes in place, without a read() per byte
+  if(!m_stream && !m_wonly && passthrough()) {
+    const uint8_t* p   = (const uint8_t*)m_fp;
+    const uint8_t* end = p + bounds(m_fp, 10);
+    for(int shift = 0; p < end; shift += 7) {
+      uint8_t b = *p++;
+      r |= (unsigned long long)(b & 0x7f) << shift;
+      if(!(b & 0x80)) {
+        m_fp = (char*)p;
+        v    = r;
+        return true;
+      }
+    }
+    return false;
+  }
+  for(int shift = 0; shift < 70; shift += 7) {
+    uint8_t b;
+    if(read(&b, 1) != 1)
+      return false;
+    r |= (unsigned long long)(b & 0x7f) << shift;
+    if(!(b & 0x80)) {
+      v = r;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool stream::read_chars(scl::string& str, size_t n, size_t max) {
+  if(n > max || n >= UINT_MAX)
+    return false;
+  if(!n) {
+    str.clear();
+    return true;
+  }
+  char* buf = str_alloc((unsigned)n, false);
+  if(read(buf, n) != (long long)n) {
+    str_release(buf);
+    return false;
+  }
+  str.clear();
+  str.m_buf    = buf;
+  str.m_ln     = (unsigned)n;
+  str.m_sz     = (unsigned)n;
+  str.m_shared = true;
+  return true;
+}
+
+#ifdef __linux__
+/* Copies up to `max` bytes between two files in the kernel, starting at the
+ * given offsets, which are advanced. Returns the number of bytes copied, or -1
+ * if neither copy_file_range() nor sendfile() work for these files. Stops
+ * early at the end of `in`, or on an error once copying has started, so a
+ * short count is not a clean end by itself. */
+static long long fd_copy(int in, off_t& inoff, int out, off_t& outoff,
+  size_t max) {
+  size_t total = 0;
+  bool   range = true;
+  while(total < max) {
+    size_t  n = std::min(max - total, (size_t)1 << 30);
+    ssize_t r;
+    if(range) {
+      r = copy_file_range(in, &inoff, out, &outoff, n, 0);
+      // Unsupported by the kernel, or across these file systems
+      if(r < 0 && errno != EINTR && errno != EIO && errno != ENOSPC) {
+        range = false;
+        continue;
+      }
+    } else {
+      // sendfile() writes at the file offset of `out`
+      if(lseek(out, outoff, SEEK_SET) == -1)
+        return total ? (long long)total : -1;
+      r = sendfile(out, in, &inoff, n);
+      if(r > 0)
+        outoff += r;
+    }
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r < 0 && !total)
+      return -1;
+    if(r <= 0)
+      break;
+    total += r;
+  }
+  return total;
+}
+#endif
+
 bool stream::write(stream& src, size_t max) {
+  if(&src == this)
+    return false;
+  // Memory or mapped source: one write() for the whole range. That is a single
+  // memcpy() into memory, and a single fwrite() into a file.
+  if(!src.m_stream && !src.m_wonly && src.passthrough()) {
+    size_t foff  = src.m_fp - src.m_data;
+    size_t avail = foff < src.m_size ? src.m_size - foff : 0;
+    size_t n     = std::min(max, avail);
+    if(!n)
+      return true;
+    src.m_fp += n;
+    if(!write(src.m_data + foff, n, 1, false))
+      return false;
+    flush();
+    return true;
+  }
+#ifdef __linux__
+  // File to file: let the kernel copy, without going through user space.
+  // Offsets are passed explicitly, and both FILEs resynced after.
+  if(src.m_stream && m_stream && !m_data && !m_ronly && !src.m_wonly &&
+     !m_direct && !src.m_direct && passthrough() && src.passthrough()) {
+    int  in  = fileno(src.m_stream);
+    int  out = fileno(m_stream);
+    // Appending writes ignore the offset, so copy_file_range() refuses them
+    bool app = fcntl(out, F_GETFL) & O_APPEND;
+    if(!app) {
+      if(src.m_dir == DIR_WRITE)
+        fflush(src.m_stream);
+      fflush(m_stream);
+      off_t     inoff  = (off_t)file_tell(src.m_stream);
+      off_t     outoff = (off_t)file_tell(m_stream);
+      long long r      = fd_copy(in, inoff, out, outoff, max);
+      if(r >= 0) {
+        file_seek(src.m_stream, inoff, SEEK_SET);
+        file_seek(m_stream, outoff, SEEK_SET);
+        src.m_dir = DIR_NONE;
+        m_dir     = DIR_NONE;
+        if(r)
+          m_modified = true;
+        if((size_t)r == max)
+          return true;
+        // Short copy: the buffered loop finishes it, and reads 0 at the end
+        // of src, or fails on the same error
+        max -= (size_t)r;
+      }
+    }
+  }
+#endif
   char   buf[SCL_STREAM_BUF];
   size_t total = 0;
   bool   r     = true;
   do {
     if(total >= max)
       break;
-    size_t read      = src.read(buf, SCL_STREAM_BUF);
-    size_t avail     = max - total;
-    size_t readBytes = avail < read ? avail : read;
-    total += read;
+    // Dont read past max, so src is left right after the written bytes
+    size_t readBytes = src.read(buf, std::min(max - total,
+      (size_t)SCL_STREAM_BUF));
+    total += readBytes;
     if(readBytes)
       // Write. Flush if the streaming buffer isnt full (usually end of
       // streaming).
@@ -935,17 +2353,267 @@ void stream::close() {
   close_internal();
 }
 
+bool stream::passthrough() const {
+  return true;
+}
+
+substream::substream(stream& parent, long long off, size_t len) {
+  open(parent, off, len);
+}
+
+void substream::open(stream& parent, long long off, size_t len) {
+  m_parent   = &parent;
+  m_off      = std::max(off, 0LL);
+  m_pos      = 0;
+  // The window size doubles as size()
+  m_size     = len;
+  m_modified = false;
+}
+
+stream* substream::parent() const {
+  return m_parent;
+}
+
+long long substream::offset() const {
+  return m_off;
+}
+
+bool substream::passthrough() const {
+  // No buffer of its own, everything goes through the parent
+  return false;
+}
+
+long long substream::tell() const {
+  return m_pos;
+}
+
+long long substream::seek(StreamPos pos, long long off) {
+  if(pos == StreamPos::start)
+    m_pos = 0;
+  else if(pos == StreamPos::end)
+    m_pos = m_size;
+  m_pos = std::min(std::max(m_pos + off, 0LL), (long long)m_size);
+  return m_pos;
+}
+
+long long substream::read(void* buf, size_t n) {
+  long long r = read_at(m_pos, buf, n);
+  m_pos += r;
+  return r;
+}
+
+long long substream::read_at(long long off, void* buf, size_t n) {
+  if(!m_parent || off < 0 || (size_t)off >= m_size)
+    return 0;
+  n = std::min(n, m_size - (size_t)off);
+  return m_parent->read_at(m_off + off, buf, n);
+}
+
+bool substream::write(const void* buf, size_t n, size_t, bool flush) {
+  if(!write_at(m_pos, buf, n))
+    return false;
+  m_pos += n;
+  if(flush)
+    m_parent->flush();
+  return true;
+}
+
+bool substream::write_at(long long off, const void* buf, size_t n) {
+  if(!m_parent || m_ronly || off < 0 || (size_t)off > m_size ||
+     n > m_size - (size_t)off)
+    return false;
+  if(!m_parent->write_at(m_off + off, buf, n))
+    return false;
+  m_modified = true;
+  return true;
+}
+
+bool substream::advise(Advice advice, long long off, size_t len) {
+  if(!m_parent || off < 0 || (size_t)off >= m_size)
+    return false;
+  // Keep the range inside the window
+  len = len ? std::min(len, m_size - (size_t)off) : m_size - (size_t)off;
+  return m_parent->advise(advice, m_off + off, len);
+}
+
+void substream::close() {
+  m_parent = nullptr;
+  m_off    = 0;
+  m_pos    = 0;
+  m_size   = 0;
+}
+
+chunk_stream::chunk_stream(size_t chunk) : m_chunk(std::max(chunk, (size_t)1)) {
+}
+
+chunk_stream::~chunk_stream() {
+  close();
+}
+
+bool chunk_stream::passthrough() const {
+  // No contiguous buffer, everything goes through the chunks
+  return false;
+}
+
+bool chunk_stream::grow(size_t size) {
+  while(m_chunks.size() * m_chunk < size) {
+    char* c = (char*)m_alloc->allocate(m_chunk);
+    if(!c)
+      return false;
+    m_blocks.push_back({c, m_chunk});
+    m_chunks.push_back(c);
+  }
+  return true;
+}
+
+const void* chunk_stream::linearize() {
+  if(!m_size)
+    return nullptr;
+  // Already contiguous
+  if(m_size <= m_chunk || m_blocks.size() == 1)
+    return m_chunks[0];
+  // Chunks are carved out of one block, so they can still be indexed
+  size_t total = m_chunks.size() * m_chunk;
+  char*  b     = (char*)m_alloc->allocate(total);
+  if(!b)
+    return nullptr;
+  for(size_t i = 0; i < m_chunks.size(); i++) {
+    size_t off = i * m_chunk;
+    if(off < m_size)
+      memcpy(b + off, m_chunks[i], std::min(m_chunk, m_size - off));
+    m_chunks[i] = b + off;
+  }
+  for(auto& blk : m_blocks)
+    m_alloc->deallocate(blk.ptr, blk.size);
+  m_blocks.clear();
+  m_blocks.push_back({b, total});
+  return b;
+}
+
+bool chunk_stream::write_to(stream& out) {
+  for(size_t off = 0; off < m_size; off += m_chunk) {
+    size_t c = std::min(m_chunk, m_size - off);
+    if(!out.write(m_chunks[off / m_chunk], c, 1, false))
+      return false;
+  }
+  return true;
+}
+
+bool chunk_stream::read_all(scl::string& out, size_t max) {
+  size_t n = m_pos < m_size ? std::min(m_size - m_pos, max) : 0;
+  if(n >= UINT_MAX)
+    return false;
+  out.clear();
+  if(!n)
+    return true;
+  char* buf    = str_alloc((unsigned)n, false);
+  read(buf, n);
+  out.m_buf    = buf;
+  out.m_ln     = (unsigned)n;
+  out.m_sz     = (unsigned)n;
+  out.m_shared = true;
+  return true;
+}
+
+long long chunk_stream::tell() const {
+  return m_pos;
+}
+
+long long chunk_stream::seek(StreamPos pos, long long off) {
+  long long p = m_pos;
+  if(pos == StreamPos::start)
+    p = 0;
+  else if(pos == StreamPos::end)
+    p = m_size;
+  m_pos = (size_t)std::max(p + off, 0LL);
+  return m_pos;
+}
+
+long long chunk_stream::read(void* buf, size_t n) {
+  long long r = read_at(m_pos, buf, n);
+  m_pos += r;
+  return r;
+}
+
+long long chunk_stream::read_at(long long off, void* buf, size_t n) {
+  if(off < 0 || (size_t)off >= m_size)
+    return 0;
+  size_t pos = (size_t)off;
+  n          = std::min(n, m_size - pos);
+  char*  out = (char*)buf;
+  for(size_t done = 0; done < n;) {
+    size_t o = pos % m_chunk;
+    size_t c = std::min(n - done, m_chunk - o);
+    memcpy(out + done, m_chunks[pos / m_chunk] + o, c);
+    pos += c;
+    done += c;
+  }
+  return n;
+}
+
+bool chunk_stream::write(const void* buf, size_t n, size_t, bool) {
+  if(!write_at(m_pos, buf, n))
+    return false;
+  m_pos += n;
+  return true;
+}
+
+bool chunk_stream::write_at(long long off, const void* buf, size_t n) {
+  if(!buf || off < 0 || !grow((size_t)off + n))
+    return false;
+  size_t pos = (size_t)off;
+  // Zero the gap left by seeking past the end
+  for(size_t p = m_size; p < pos;) {
+    size_t o = p % m_chunk;
+    size_t c = std::min(pos - p, m_chunk - o);
+    memset(m_chunks[p / m_chunk] + o, 0, c);
+    p += c;
+  }
+  m_size         = std::max(m_size, pos + n);
+  const char* in = (const char*)buf;
+  for(size_t done = 0; done < n;) {
+    size_t o = pos % m_chunk;
+    size_t c = std::min(n - done, m_chunk - o);
+    memcpy(m_chunks[pos / m_chunk] + o, in + done, c);
+    pos += c;
+    done += c;
+  }
+  m_modified = true;
+  return true;
+}
+
+void chunk_stream::flush() {
+}
+
+void chunk_stream::close() {
+  for(auto& blk : m_blocks)
+    m_alloc->deallocate(blk.ptr, blk.size);
+  m_blocks.clear();
+  m_chunks.clear();
+  m_size     = 0;
+  m_pos      = 0;
+  m_modified = false;
+}
+
+allocator& stream::get_allocator() const {
+  return *m_alloc;
+}
+
 const void* stream::data() {
   return m_data;
 }
 
-void* stream::release() {
-  void* ptr = nullptr;
-  if(m_data) {
-    ptr = m_data;
-    // Reset members
-    close_internal();
-  }
+void* stream::release(size_t* cap) {
+  if(cap)
+    *cap = 0;
+  if(!m_data || m_mapped)
+    return nullptr;
+  void* ptr = m_data;
+  if(cap)
+    *cap = m_cap;
+  // Detach the buffer, so it isnt freed when resetting members
+  m_data    = nullptr;
+  close_internal();
   return ptr;
 }
 
@@ -955,26 +2623,12 @@ stream& stream::operator<<(const scl::string& str) {
 }
 
 stream& stream::operator>>(scl::string& str) {
-  auto      off = tell();
-  long long end = seek(StreamPos::end, 0);
-  seek(StreamPos::start, off);
-  if(end >= UINT_MAX)
-    return *this;
-  char* buf = new char[SCL_STREAM_BUF];
-  str.reserve((unsigned)end);
-  for(;;) {
-    auto readBytes = read(buf, SCL_STREAM_BUF - 1);
-    if(!readBytes)
-      break;
-    buf[readBytes] = 0;
-    str.operator+= <256>(buf);
-  }
-  delete[] buf;
+  read_all(str);
   return *this;
 }
 
 bool init() {
-  srand_(scl::clock());
+  srand_((int)(time(NULL) ^ nanos()));
   return true;
 }
 
@@ -8,9 +8,20 @@
 #include <fstream>
 #include <functional>
 #include <algorithm>
+#include <type_traits>
+#include <vector>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#  define SCL_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+  (defined(__x86_64__) || defined(__i386__))
+#  define SCL_RDTSC
+#endif
+
 #ifdef max
 #  undef max
 #endif
@@ -23,6 +34,35 @@
 #  define SCL_STREAM_BUF 0x8000
 #endif
 
+// Default size of the buffer used by file mode streams. Can be changed per
+// stream with scl::stream::buffer().
+#ifndef SCL_FILE_BUF
+#  define SCL_FILE_BUF 0x10000
+#endif
+
+// Default size of the chunks of a scl::chunk_stream.
+#ifndef SCL_CHUNK_SIZE
+#  define SCL_CHUNK_SIZE 0x10000
+#endif
+
+// Size of each of the two buffers used by OpenMode::DIRECT streams.
+#ifndef SCL_DIRECT_BUF
+#  define SCL_DIRECT_BUF 0x100000
+#endif
+
+// Min length of a string before copies of it share its buffer, instead of
+// copying it.
+#ifndef SCL_STRING_SHARE
+#  define SCL_STRING_SHARE 32
+#endif
+
+// Defined on big endian hosts. Binary formats written by scl are little endian.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+#  if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#    define SCL_BIG_ENDIAN
+#  endif
+#endif
+
 /**
  * @brief Main SCL namespace
  *
@@ -39,17 +79,92 @@ uchar                 log2i(unsigned x);
  */
 namespace internal {
 class str_iterator;
+class slice_tokens;
+struct direct_writer;
 } // namespace internal
 
+class slice;
+
+/**
+ * @brief  Interface for a memory allocator. Used for the buffers of
+ * scl::string, memory mode scl::stream, and xml documents, so they can come
+ * from an arena, a pool, huge pages, etc.
+ * Allocators are passed around by reference, and must outlive every block
+ * they handed out.
+ */
+class allocator {
+ public:
+  virtual ~allocator() = default;
+
+  /**
+   * @brief  Allocates `n` bytes, aligned to at least 8 bytes.
+   * @return  The allocated block, or nullptr on failure.
+   */
+  virtual void* allocate(size_t n) = 0;
+
+  /**
+   * @brief  Resizes a block from allocate(), keeping its contents. By default
+   * allocates a new block, copies, and deallocates the old one.
+   *
+   * @param  ptr  Block to resize. May be nullptr.
+   * @param  old  Current size of `ptr` in bytes.
+   * @param  n  New size in bytes.
+   * @return  The resized block, or nullptr on failure, in which case `ptr` is
+   * left untouched.
+   */
+  virtual void* reallocate(void* ptr, size_t old, size_t n);
+
+  /**
+   * @brief  Frees a block from allocate(). An arena can do nothing here, and
+   * free everything at once instead.
+   *
+   * @param  ptr  Block to free.
+   * @param  n  Size of `ptr` in bytes.
+   */
+  virtual void  deallocate(void* ptr, size_t n) = 0;
+
+  /**
+   * @return  The global heap allocator, using malloc(), realloc() and free().
+   */
+  static allocator& heap();
+
+  /**
+   * @return  The allocator new strings, streams and xml documents on the
+   * calling thread use. heap() unless changed by a scope.
+   */
+  static allocator& current();
+
+  /**
+   * @brief  Makes an allocator the calling thread's current() allocator,
+   * until the scope is destroyed.
+   * Ex: { scl::allocator::scope s(arena); doc.load_file(path); }
+   */
+  class scope {
+    allocator* m_prev;
+
+   public:
+    scope(allocator& alloc);
+    scope(const scope&) = delete;
+    ~scope();
+  };
+};
+
 class string {
  private:
   friend class internal::str_iterator;
+  friend class slice;
+  friend class stream;
+  friend class chunk_stream;
 
   // If m_buf is a view, m_sz will be 0, while m_buf will be non-zero.
   // In this case, m_ln will also represent m_sz.
-  char*    m_buf = nullptr;
-  uint32_t m_ln  = 0;
-  uint32_t m_sz  = 0;
+  // If m_shared is set, m_buf is preceded by an atomic reference count and
+  // its allocator, and may be shared with other strings. It must not be
+  // written to unless this string is its only owner (see make_unique()).
+  char*    m_buf    = nullptr;
+  uint32_t m_ln     = 0;
+  uint32_t m_sz     = 0;
+  bool     m_shared = false;
 
   bool     isview() const;
   void     make_unique();
@@ -62,6 +177,7 @@ class string {
   string(const wchar_t*);
 #endif
   string(const scl::string&);
+  string(scl::string&&);
   ~string();
 
   /**
@@ -71,9 +187,10 @@ class string {
   void         clear();
 
   /**
-   * @brief Takes ownership of `ptr`.
-   * @note The given pointer will be treated as if scl::string created it, so
-   * ensure no other structures are managing it.
+   * @brief Takes ownership of `ptr`, a string allocated with new[]. Its
+   * contents are moved into a buffer from allocator::current(), and `ptr` is
+   * deleted.
+   * @note Ensure no other structures are managing the given pointer.
    *
    * @param ptr Pointer to take ownership of.
    */
@@ -94,6 +211,15 @@ class string {
    */
   scl::string& reserve(unsigned size);
 
+  /**
+   * @brief Replaces the contents with `len` uninitialized chars, allocated
+   * from allocator::current(). Lets the caller fill the string in place.
+   *
+   * @param len Length of the new contents.
+   * @return  Buffer to write the `len` chars to. The terminator is set.
+   */
+  char*        alloc(unsigned len);
+
   /**
    * @brief Returns the managed string buffer of this string object. Does not
    * need to be freed.
@@ -118,12 +244,23 @@ class string {
 
   /**
    * @brief Attempts to convert as much of this string into an integer as
-   * possible. Automatically detects hexedecimal literals.
+   * possible. Accepts a sign, and detects hexedecimal literals by their 0x
+   * prefix.
    *
-   * @return  An integer representation of this string.
+   * @return  An integer representation of this string. 0 if no integer could
+   * be parsed.
    */
   long long        toInt() const;
 
+  /**
+   * @brief Attempts to convert as much of this string into a double as
+   * possible. Locale independent, see scl::from_chars().
+   *
+   * @return  A double representation of this string. 0 if no number could be
+   * parsed.
+   */
+  double           toFloat() const;
+
   /**
    * @brief Returns the length of this string, excluding null terminator.
    *
@@ -180,6 +317,21 @@ class string {
    */
   unsigned         hash() const;
 
+  /**
+   * @brief Returns a case insensitive hash of this string. Strings that only
+   * differ in ASCII case have the same ihash().
+   *
+   */
+  unsigned         ihash() const;
+
+  /**
+   * @brief Compares this string with another, ignoring ASCII case.
+   *
+   * @param rhs String to compare with.
+   * @return true if both strings are equal, ignoring case.
+   */
+  bool             iequals(const scl::string& rhs) const;
+
   /**
    * @brief Returns a substring of this string.
    *
@@ -219,6 +371,12 @@ class string {
    */
   scl::string&     toUpper();
 
+  /**
+   * @brief Replaces all uppercase ascii characters with their lowercase
+   * counterparts.
+   */
+  scl::string&     toLower();
+
   /**
    * @brief  Finds the first instance of a pattern in the given string.
    *
@@ -244,6 +402,22 @@ class string {
    * @param len Length in characters of the randomized string.
    */
   static scl::string     rand(unsigned len);
+
+  /**
+   * @brief Returns the string representation of an integer.
+   *
+   * @param v Integer to format.
+   * @param base Base to format in, from 2 to 36.
+   */
+  static scl::string     fromInt(long long v, int base = 10);
+
+  /**
+   * @brief Returns the shortest string representation of a double, that
+   * parses back into the same value. See scl::to_chars().
+   *
+   * @param v Double to format.
+   */
+  static scl::string     fromFloat(double v);
   static scl::string     vfmt(const char* fmt, va_list args);
 
   /**
@@ -332,27 +506,286 @@ class string {
                         operator bool() const;
 
   scl::string&          operator=(const scl::string&);
+  scl::string&          operator=(scl::string&&);
 
   friend std::ifstream& operator>>(std::ifstream& in, scl::string& str);
 };
 
+/**
+ * @brief Readonly, non owning window into a string buffer. Unlike a viewing
+ * scl::string, a slice does not need to be null terminated, so slicing,
+ * trimming, and splitting never allocate.
+ * @note A slice is only valid for as long as the buffer it looks into.
+ */
+class slice {
+ private:
+  const char* m_buf = nullptr;
+  unsigned    m_ln  = 0;
+
+ public:
+  slice() = default;
+  slice(const char* str);
+  slice(const char* str, unsigned len);
+  slice(const scl::string& str);
+
+  /**
+   * @return  Pointer to the first char of this slice. Not null terminated.
+   */
+  const char*          data() const;
+
+  /**
+   * @return  Length of this slice in bytes.
+   */
+  unsigned             len() const;
+
+  /**
+   * @brief Returns a slice of this slice. Out of range values are clamped.
+   *
+   * @param i The start index of the slice.
+   * @param j The length of the slice.
+   */
+  scl::slice           substr(unsigned i, unsigned j = -1) const;
+
+  /**
+   * @brief Finds the first instance of a pattern in this slice.
+   *
+   * @param pattern A pattern to search for (no wildcard supported).
+   * @return Index of the first instance found. -1 if no instance is
+   * found.
+   */
+  long long            ffi(const scl::slice& pattern) const;
+
+  /**
+   * @brief Finds the last instance of a pattern in this slice.
+   *
+   * @param pattern A pattern to search for (no wildcard supported).
+   * @return Index of the last instance found. -1 if no instance is
+   * found.
+   */
+  long long            fli(const scl::slice& pattern) const;
+
+  bool                 startswith(const scl::slice& pattern) const;
+  bool                 endswith(const scl::slice& pattern) const;
+
+  /**
+   * @return  This slice, without leading and trailing whitespace.
+   */
+  scl::slice           trim() const;
+
+  /**
+   * @return  This slice, without leading whitespace.
+   */
+  scl::slice           ltrim() const;
+
+  /**
+   * @return  This slice, without trailing whitespace.
+   */
+  scl::slice           rtrim() const;
+
+  /**
+   * @brief  Splits this slice on every instance of `delim`. Empty pieces are
+   * kept, so "a,,b" splits into {a, "", b}.
+   * Ex: for(scl::slice s : line.split(",")) ...
+   *
+   * @param  delim  Delimiter to split on.
+   * @return  Iterable range of slices into this slice's buffer.
+   */
+  internal::slice_tokens split(const scl::slice& delim) const;
+
+  /**
+   * @brief  Splits this slice on any of the chars in `delims`. Empty pieces
+   * are skipped, so "a  b" tokenizes into {a, b} with delims " ".
+   *
+   * @param  delims  Set of delimiter chars.
+   * @return  Iterable range of slices into this slice's buffer.
+   */
+  internal::slice_tokens tokens(const scl::slice& delims) const;
+
+  /**
+   * @return  An owning, null terminated copy of this slice.
+   */
+  scl::string          copy() const;
+
+  /**
+   * @brief Same as scl::string::toInt(), without needing a null terminator.
+   */
+  long long            toInt() const;
+
+  /**
+   * @brief Same as scl::string::toFloat(), without needing a null terminator.
+   */
+  double               toFloat() const;
+
+  /**
+   * @brief Returns a hash of this slice. Matches the hash of an scl::string
+   * with the same contents.
+   *
+   */
+  unsigned             hash() const;
+
+  /**
+   * @brief Returns a case insensitive hash of this slice. Matches
+   * scl::string::ihash().
+   *
+   */
+  unsigned             ihash() const;
+
+  /**
+   * @brief Compares this slice with another, ignoring ASCII case.
+   */
+  bool                 iequals(const scl::slice& rhs) const;
+
+  const char*          begin() const;
+  const char*          end() const;
+
+  char                 operator[](unsigned i) const;
+
+  bool                 operator==(const scl::slice&) const;
+  bool                 operator!=(const scl::slice&) const;
+
+  /**
+   * @brief  Equivalent to strcmp() < 0
+   */
+  bool                 operator<(const scl::slice&) const;
+
+  /**
+   * @return  true if this slice is not empty.
+   */
+                       operator bool() const;
+};
+
+namespace internal {
+class slice_iterator {
+  const char* m_p = nullptr;
+  const char* m_e = nullptr;
+  scl::slice  m_tok;
+  scl::slice  m_delim;
+  bool        m_any = false;
+
+  void        next();
+
+ public:
+  slice_iterator() = default;
+  slice_iterator(const scl::slice& str, const scl::slice& delim, bool any);
+
+  bool              operator==(const slice_iterator& rhs) const;
+  bool              operator!=(const slice_iterator& rhs) const;
+  slice_iterator&   operator++();
+  const scl::slice& operator*() const;
+  const scl::slice* operator->() const;
+};
+
+class slice_tokens {
+  scl::slice m_str;
+  scl::slice m_delim;
+  bool       m_any;
+
+ public:
+  slice_tokens(const scl::slice& str, const scl::slice& delim, bool any);
+
+  slice_iterator begin() const;
+  slice_iterator end() const;
+};
+} // namespace internal
+
+/**
+ * @brief  Case insensitive hash policy for scl::dictionary.
+ * Ex: scl::dictionary<int, scl::string, scl::ihash> dict;
+ */
+struct ihash {
+  static unsigned hash(const scl::string& str) {
+    return str.ihash();
+  }
+};
+
+/**
+ * @brief  Hash functor for scl::string keys in std containers. Hashes ignoring
+ * ASCII case if `icase` is set. Pair with scl::string_equal.
+ */
+struct string_hash {
+  bool icase;
+
+  string_hash(bool icase = false) : icase(icase) {
+  }
+
+  size_t operator()(const scl::string& str) const noexcept {
+    return icase ? str.ihash() : str.hash();
+  }
+};
+
+/**
+ * @brief  Equality functor for scl::string keys in std containers. Compares
+ * ignoring ASCII case if `icase` is set. Pair with scl::string_hash.
+ */
+struct string_equal {
+  bool icase;
+
+  string_equal(bool icase = false) : icase(icase) {
+  }
+
+  bool operator()(const scl::string& a, const scl::string& b) const {
+    return icase ? a.iequals(b) : a == b;
+  }
+};
+
 std::ostream& operator<<(std::ostream& out, const scl::string& str);
 
 scl::string   operator+(const scl::string& str, const char* str2);
 
 /**
- * @brief Resets the output of scl::clock(), making current time epoch.
+ * @brief Resets the output of scl::clock(), making the current time its
+ * origin.
  *
  */
 void          resetclock();
 
 /**
- * @note You can use scl::resetclock() to control this function's epoch.
+ * @note Monotonic, so it never jumps when the system time is adjusted. It used
+ * to count wall time since the Unix epoch; it no longer does, so it cannot be
+ * compared with time(), or across processes.
  *
- * @return   Seconds since epoch.
+ * @return   Seconds since scl::resetclock() was last called. Without a call,
+ * seconds since an unspecified origin (boot time, on most systems).
  */
 double        clock();
 
+/**
+ * @return  Nanoseconds on a monotonic clock, from an unspecified point.
+ */
+uint64_t      nanos();
+
+/**
+ * @brief  Reads the CPU's cycle counter (rdtsc), which is cheaper than
+ * nanos(), for timing very short sections. Falls back to nanos() on other
+ * architectures.
+ * @note  Assumes an invariant counter, synchronized across cores, as on any
+ * x86 CPU of the last decade.
+ *
+ * @return  Cycle count, from an unspecified point.
+ */
+inline uint64_t cycles() {
+#if defined(SCL_RDTSC) && defined(_MSC_VER)
+  return __rdtsc();
+#elif defined(SCL_RDTSC)
+  return __builtin_ia32_rdtsc();
+#else
+  return nanos();
+#endif
+}
+
+/**
+ * @return  Number of cycles() per second. Calibrated against nanos() on first
+ * call, which takes about 10ms.
+ */
+double        cyclerate();
+
+/**
+ * @brief  Converts a number of cycles() to nanoseconds.
+ */
+inline double cycles_to_ns(uint64_t c) {
+  return (double)c * 1e9 / cyclerate();
+}
+
 /**
  * @brief Makes this thread sleep for a given amount of milliseconds.
  *
@@ -372,6 +805,129 @@ void          waitms(double ms);
 bool          waitUntil(std::function<bool()> cond, double timeout = -1,
            double sleepms = 0.001);
 
+/**
+ * @brief  Measures elapsed time on the monotonic clock, from construction or
+ * the last reset().
+ */
+class timer {
+  uint64_t m_start;
+
+ public:
+  timer() : m_start(nanos()) {
+  }
+
+  /**
+   * @brief  Restarts the measurement.
+   */
+  void reset() {
+    m_start = nanos();
+  }
+
+  /**
+   * @return  Nanoseconds elapsed.
+   */
+  uint64_t ns() const {
+    return nanos() - m_start;
+  }
+
+  /**
+   * @return  Seconds elapsed.
+   */
+  double elapsed() const {
+    return (double)ns() / 1e9;
+  }
+};
+
+/**
+ * @brief  Times its own scope. On destruction, adds the nanoseconds it lived
+ * for to a counter, or hands them to a callback.
+ *
+ * @code
+ * uint64_t parse_ns = 0;
+ * {
+ *   scl::scoped_timer t(parse_ns);
+ *   doc.load_file(path);
+ * }
+ * @endcode
+ */
+class scoped_timer {
+  timer                         m_timer;
+  uint64_t*                     m_total = nullptr;
+  std::function<void(uint64_t)> m_cb;
+
+ public:
+  scoped_timer(uint64_t& total) : m_total(&total) {
+  }
+
+  scoped_timer(std::function<void(uint64_t)> cb) : m_cb(std::move(cb)) {
+  }
+
+  scoped_timer(const scoped_timer&)            = delete;
+  scoped_timer& operator=(const scoped_timer&) = delete;
+
+  ~scoped_timer() {
+    uint64_t ns = m_timer.ns();
+    if(m_total)
+      *m_total += ns;
+    if(m_cb)
+      m_cb(ns);
+  }
+};
+
+/**
+ * @brief  Reverses the byte order of a value.
+ */
+template <class T>
+inline T byteswap(T v) {
+  // Compilers turn this into a single bswap
+  unsigned char b[sizeof(T)];
+  memcpy(b, &v, sizeof(T));
+  std::reverse(b, b + sizeof(T));
+  memcpy(&v, b, sizeof(T));
+  return v;
+}
+
+/**
+ * @brief  Converts a value between host and little endian byte order. Does
+ * nothing on little endian hosts.
+ */
+template <class T>
+inline T le(T v) {
+#ifdef SCL_BIG_ENDIAN
+  return byteswap(v);
+#else
+  return v;
+#endif
+}
+
+/**
+ * @brief  Loads a little endian value from possibly unaligned memory.
+ */
+template <class T>
+inline T load_le(const void* p) {
+  T v;
+  memcpy(&v, p, sizeof(T));
+  return le(v);
+}
+
+/**
+ * @brief  Stores a value as little endian into possibly unaligned memory.
+ */
+template <class T>
+inline void store_le(void* p, T v) {
+  v = le(v);
+  memcpy(p, &v, sizeof(T));
+}
+
+/**
+ * @brief  One buffer of a scatter/gather operation. See stream::readv() and
+ * stream::writev().
+ */
+struct iobuf {
+  void*  data;
+  size_t len;
+};
+
 enum class StreamPos {
   start   = SEEK_SET,
   end     = SEEK_END,
@@ -393,6 +949,31 @@ enum class OpenMode {
   // Read/Append. Can only append content, and creates the file it it doesnt
   // exist.
   RAPPEND = 5,
+  // Read only, memory mapped. Fails if file isnt present. Reads are copies out
+  // of the mapping, and seeking is free. data() returns the mapping.
+  MAP = 6,
+  // Write only, truncates or creates the file, for large sequential writes.
+  // Appends bypass the page cache (O_DIRECT), and are written out in the
+  // background from aligned double buffers. Seeking or reading ends the
+  // unbuffered phase, the stream then behaves like RWTRUNC. Same as RWTRUNC
+  // where O_DIRECT is unsupported.
+  DIRECT = 7,
+};
+
+/**
+ * @brief  Expected access pattern of a range of a stream. See stream::advise().
+ */
+enum class Advice {
+  // No particular pattern. The default.
+  NORMAL = 0,
+  // Read front to back. Read ahead more aggressively.
+  SEQUENTIAL = 1,
+  // Read at random offsets. Do not read ahead.
+  RANDOM = 2,
+  // Will be read soon. Starts reading it in, in the background.
+  WILLNEED = 3,
+  // Will not be read again soon. Its cached pages may be dropped.
+  DONTNEED = 4,
 };
 
 class stream {
@@ -401,17 +982,46 @@ class stream {
   char*     m_data   = nullptr;
   char*     m_fp     = nullptr;
   size_t    m_size   = 0;
+  // Allocated bytes of m_data, in memory mode
+  size_t    m_cap    = 0;
   bool      m_ronly = false, m_wonly = false;
   bool      m_modified = false;
+  // m_data is a read only file mapping, instead of an owned buffer
+  bool      m_mapped   = false;
+  // Last file operation. stdio needs a seek or flush between reads and writes.
+  enum { DIR_NONE, DIR_READ, DIR_WRITE } m_dir = DIR_NONE;
+  size_t    m_bufsz                           = SCL_FILE_BUF;
+  // Allocator of m_data, in memory mode
+  allocator* m_alloc = &allocator::current();
+  // Unbuffered appends, in OpenMode::DIRECT
+  internal::direct_writer* m_direct = nullptr;
+  // A deferred write of m_direct failed. Later writes and seeks fail too.
+  bool      m_failed  = false;
+  // Line buffer of read_until() in file mode
+  char*     m_line    = nullptr;
+  size_t    m_linecap = 0;
 
   long long bounds(const char* p, size_t n) const;
+  bool      map(const scl::path& path);
+  void      unmap();
+  void      direction(int dir);
+  void      direct_end();
 
   long long read_internal(void* buf, size_t n);
   bool      write_internal(const void* buf, size_t n, size_t align);
   void      close_internal();
+  bool      read_chars(scl::string& str, size_t n, size_t max);
+
+  /**
+   * @return  true if read() and write() move bytes as they are, so transfers
+   * between streams may go around them. Derived streams that transform data
+   * return false.
+   */
+  virtual bool passthrough() const;
 
  public:
   stream()                  = default;
+  stream(allocator& alloc);
   stream(const stream& rhs) = delete;
   stream(stream&& rhs);
   stream& operator=(const stream& rhs) = delete;
@@ -420,24 +1030,37 @@ class stream {
   virtual ~stream();
 
   /**
-   * @return  true if this stream is in file mode, and target file was opened
-   * successfully.
+   * @return  true if this stream is in file mode (or mapped), and target file
+   * was opened successfully.
    */
   bool         is_open() const;
 
+  /**
+   * @return  File descriptor of the open file in file mode, -1 otherwise.
+   */
+  int          fd() const;
+
   /**
    * @return  true if this stream has been written to.
    */
   bool         is_modified() const;
 
+  /**
+   * @return  true if a write failed after the call that issued it returned.
+   * OpenMode::DIRECT writes complete in the background, so their failures
+   * are only seen by a later write(), flush(), seek() or close().
+   */
+  bool         failed() const;
+
   /**
    * @return  Offset in bytes of the rw pointer.
    */
-  long long    tell() const;
+  virtual long long tell() const;
 
   /**
-   * @brief Returns the current capacity of the stream.
-   * Only works in data mode, returns 0 in file mode.
+   * @brief Returns the number of bytes written to the stream.
+   * Only works in data mode, returns 0 in file mode. Returns the file size if
+   * mapped.
    */
   size_t       size() const;
 
@@ -468,7 +1091,17 @@ class stream {
   bool         open(const scl::path& path, OpenMode mode, bool binary = false);
 
   /**
-   * @brief  Used to flush internal buffers. Does nothing in memory mode.
+   * @brief  Sets the size of the buffer used in file mode. Only applies to
+   * files opened after this call.
+   *
+   * @param  n  Buffer size in bytes. 0 disables buffering.
+   * @return  false if a file is already open.
+   */
+  bool         buffer(size_t n);
+
+  /**
+   * @brief  Writes out buffered file data. Does nothing in memory mode. Reads
+   * and writes may be mixed without flushing, the stream handles that itself.
    *
    */
   virtual void flush();
@@ -481,7 +1114,7 @@ class stream {
    * @return  New offset of the rw pointer. Equivalent to calling tell() right
    * after this method call.
    */
-  long long    seek(StreamPos pos, long long off);
+  virtual long long seek(StreamPos pos, long long off);
 
   /**
    * @brief  Reads `n` bytes from this stream into `buf`. If not enough bytes
@@ -495,13 +1128,125 @@ class stream {
    */
   virtual long long read(void* buf, size_t n);
 
+  /**
+   * @brief  Reads up to the next `delim`, and moves the rw pointer past it.
+   * The delimiter is searched for with SIMD, over the memory buffer or the
+   * mapping directly, and over the stdio buffer in file mode.
+   *
+   * @param  out  Set to the bytes before `delim`, or before the end of the
+   * stream if there is no `delim` left. In memory mode and when mapped, a view
+   * of the stream's own buffer, valid until it is written to or closed.
+   * Otherwise a view of a line buffer owned by the stream, valid until the next
+   * call.
+   * @param  delim  Delimiter to stop at.
+   * @return  false if there was nothing left to read.
+   */
+  bool         read_until(scl::slice& out, char delim);
+
+  /**
+   * @brief  Reads the next line. Same as read_until(out, '\n'), but also drops
+   * a trailing '\r'.
+   *
+   * @return  false if there was nothing left to read.
+   */
+  bool         readline(scl::slice& out);
+
+  /**
+   * @brief  Reads everything from the rw pointer to the end of the stream.
+   * The length is known upfront for files, mappings and memory, so `out` is
+   * allocated once and filled by a single read, without growing or copying
+   * through an intermediate buffer.
+   *
+   * @param  out  Replaced with the bytes read. Allocated with
+   * allocator::current().
+   * @param  max  Maximum number of bytes to read.
+   * @return  false if the stream is write only, or the data does not fit in a
+   * string.
+   */
+  virtual bool read_all(scl::string& out, size_t max = -1);
+
+  /**
+   * @brief  Reads up to `n` raw bytes starting at `off`, without using or
+   * moving the rw pointer. Concurrent calls on the same stream are safe, as
+   * long as nothing writes to it at the same time.
+   * @note  On Windows, the OS file pointer still moves in file mode.
+   *
+   * @param  off  Offset in bytes from the start of the stream.
+   * @param  buf  Buffer to store read data.
+   * @param  n  Number of bytes to read.
+   * @return  Number of bytes read, 0 if nothing was read, or if an error
+   * occured.
+   */
+  virtual long long read_at(long long off, void* buf, size_t n);
+
+  /**
+   * @brief  Writes `n` raw bytes starting at `off`, without using or moving
+   * the rw pointer. Memory mode streams are grown if necessary.
+   *
+   * @param  off  Offset in bytes from the start of the stream.
+   * @param  buf  Buffer to write.
+   * @param  n  Number of bytes to write.
+   * @return  true if all `n` bytes were written.
+   */
+  virtual bool write_at(long long off, const void* buf, size_t n);
+
+  /**
+   * @brief  Tells the OS how a range of this stream is going to be accessed,
+   * so it can tune read ahead and caching. posix_fadvise() in file mode,
+   * madvise() when mapped. Only a hint, it never changes what is read.
+   *
+   * @param  advice  Expected access pattern.
+   * @param  off  Offset in bytes of the range.
+   * @param  len  Length in bytes of the range. 0 extends it to the end of the
+   * stream.
+   * @return  true if the hint was passed on. false in memory mode, or where
+   * the OS has no such hints.
+   */
+  virtual bool advise(Advice advice, long long off = 0, size_t len = 0);
+
+  /**
+   * @brief  Starts reading a range in, in the background, so later reads of
+   * it do not block on the disk. Same as advise(Advice::WILLNEED, off, len).
+   *
+   * @return  true if the hint was passed on.
+   */
+  bool         prefetch(long long off, size_t len);
+
+  /**
+   * @brief  Reads raw bytes into several buffers in order, as if by one read()
+   * per buffer. Stops at the first buffer that can not be filled.
+   * In file mode, reads larger than the file buffer are done with one readv()
+   * syscall. In memory mode, each buffer is a single copy.
+   *
+   * @param  bufs  Buffers to fill.
+   * @param  n  Number of buffers.
+   * @return  Total number of bytes read.
+   */
+  long long    readv(const iobuf* bufs, size_t n);
+
+  /**
+   * @brief  Writes raw bytes from several buffers in order, as if by one
+   * write() per buffer.
+   * In file mode, writes larger than the file buffer are done with one
+   * writev() syscall. In memory mode, space for all buffers is reserved at
+   * once.
+   *
+   * @param  bufs  Buffers to write.
+   * @param  n  Number of buffers.
+   * @param  align  How to align reserve space. See write().
+   * @return  true if all bytes were written.
+   */
+  bool         writev(const iobuf* bufs, size_t n, size_t align = 1);
+
   /**
    * @brief  Reserves space while in memory mode. Reserves space starting at the
    * rw pointer, not buffer start. By default does nothing if there is enough
-   * space remaining.
+   * space remaining. Grows the buffer geometrically, and does not change the
+   * size() of the stream. Reserved space is uninitialized.
    *
    * @param  n  Number of bytes to reserve.
-   * @param  force  Reserve space, even if there is enough space.
+   * @param  force  Reserve `n` bytes past the current capacity, even if there
+   * is enough space.
    * @return  true if the operation was successful.
    */
   bool              reserve(size_t n, bool force = false);
@@ -511,9 +1256,8 @@ class stream {
    *
    * @param  buf  Buffer to write.
    * @param  n  Number of bytes to write.
-   * @param  align  How to align reserve space. By default 1. If a multitude of
-   * writes occur to this stream, increasing this value can dramatically
-   * increase performance.
+   * @param  align  How to align reserve space. By default 1. Only a hint, the
+   * buffer already grows geometrically.
    * @param  flush  true: Automatically calls flush().
    * @return  true if the operation was successful, and the requested number of
    * bytes were written.
@@ -525,9 +1269,8 @@ class stream {
    * @brief  Writes an scl::string's length to this stream.
    *
    * @param  str  String to write.
-   * @param  align  How to align reserve space. By default 1. If a multitude of
-   * writes occur to this stream, increasing this value can dramatically
-   * increase performance.
+   * @param  align  How to align reserve space. By default 1. Only a hint, the
+   * buffer already grows geometrically.
    * @param  flush  true: Automatically calls flush().
    * @return  true if the operation was successful, and the requested number of
    * bytes were written.
@@ -535,7 +1278,130 @@ class stream {
   bool write(const scl::string& str, size_t align = 1, bool flush = false);
 
   /**
-   * @brief  Writes another scl::string into this stream.
+   * @brief  Writes an arithmetic value, in little endian byte order.
+   *
+   * @return  true if the operation was successful.
+   */
+  template <class T,
+    std::enable_if_t<std::is_arithmetic<T>::value, bool> = true>
+  bool write(T v) {
+    v = le(v);
+    return write(&v, sizeof(T));
+  }
+
+  /**
+   * @brief  Reads an arithmetic value, written in little endian byte order.
+   *
+   * @param  v  Value to read into. Untouched if not enough bytes are left.
+   * @return  true if sizeof(T) bytes were read.
+   */
+  template <class T,
+    std::enable_if_t<std::is_arithmetic<T>::value, bool> = true>
+  bool read(T& v) {
+    T r;
+    if(read(&r, sizeof(T)) != (long long)sizeof(T))
+      return false;
+    v = le(r);
+    return true;
+  }
+
+  /**
+   * @brief  Writes `n` arithmetic values, in little endian byte order, with a
+   * single write on little endian hosts.
+   *
+   * @return  true if the operation was successful.
+   */
+  template <class T,
+    std::enable_if_t<std::is_arithmetic<T>::value, bool> = true>
+  bool write_array(const T* v, size_t n) {
+    if(n > SIZE_MAX / sizeof(T))
+      return false;
+#ifdef SCL_BIG_ENDIAN
+    T buf[SCL_STREAM_BUF / sizeof(T)];
+    for(size_t i = 0; i < n;) {
+      size_t c = std::min(n - i, sizeof(buf) / sizeof(T));
+      for(size_t j = 0; j < c; j++)
+        buf[j] = le(v[i + j]);
+      if(!write(buf, c * sizeof(T)))
+        return false;
+      i += c;
+    }
+    return true;
+#else
+    return !n || write((const void*)v, n * sizeof(T));
+#endif
+  }
+
+  /**
+   * @brief  Reads `n` arithmetic values, written in little endian byte order.
+   *
+   * @return  true if all `n` values were read.
+   */
+  template <class T,
+    std::enable_if_t<std::is_arithmetic<T>::value, bool> = true>
+  bool read_array(T* v, size_t n) {
+    if(n > SIZE_MAX / sizeof(T))
+      return false;
+    if(read((void*)v, n * sizeof(T)) != (long long)(n * sizeof(T)))
+      return false;
+#ifdef SCL_BIG_ENDIAN
+    for(size_t i = 0; i < n; i++)
+      v[i] = le(v[i]);
+#endif
+    return true;
+  }
+
+  /**
+   * @brief  Writes an unsigned LEB128 varint. Values under 128 take 1 byte, up
+   * to 10 bytes for 64 bit values.
+   *
+   * @return  true if the operation was successful.
+   */
+  bool write_varint(unsigned long long v);
+
+  /**
+   * @brief  Reads an unsigned LEB128 varint.
+   *
+   * @param  v  Value to read into. Untouched on failure.
+   * @return  false if the stream ended before the varint did, or the varint
+   * is longer than 10 bytes.
+   */
+  bool read_varint(unsigned long long& v);
+
+  /**
+   * @brief  Writes a string, prefixed by its length as a little endian `L`.
+   *
+   * @return  false if the string is too long for `L`, or the write failed.
+   */
+  template <class L = uint32_t,
+    std::enable_if_t<std::is_unsigned<L>::value, bool> = true>
+  bool write_string(const scl::string& str) {
+    unsigned n = str.len();
+    if(n > (L)-1)
+      return false;
+    return write((L)n) && (!n || write(str.cstr(), n));
+  }
+
+  /**
+   * @brief  Reads a string written by write_string(), with the same `L`.
+   *
+   * @param  str  String to read into. Untouched on failure.
+   * @param  max  Max accepted length. Guards against allocating for garbage
+   * lengths. By default -1 (infinite).
+   * @return  false if the length is over `max`, or the stream ended early.
+   */
+  template <class L = uint32_t,
+    std::enable_if_t<std::is_unsigned<L>::value, bool> = true>
+  bool read_string(scl::string& str, size_t max = -1) {
+    L n;
+    return read(n) && read_chars(str, n, max);
+  }
+
+  /**
+   * @brief  Writes another scl::stream into this stream, from its rw pointer.
+   * Memory and mapped sources are written with a single write() call. File to
+   * file transfers are done by the kernel (copy_file_range()/sendfile()) when
+   * possible.
    *
    * @param  src  Stream to read from.
    * @param  max  Max number of bytes to write. By default -1 (infinite).
@@ -552,6 +1418,7 @@ class stream {
 
   /**
    * @return   Returns a pointer to the internal data buffer, if in memory mode.
+   * Returns the read only file mapping, if opened with OpenMode::MAP.
    * Returns nullptr if operating in file mode.
    * @warning Do not free the pointer that is returned by this method. And it is
    * possible for this pointer to be invalidated, if the stream owning it
@@ -563,15 +1430,162 @@ class stream {
    * @brief  Releases the internal data buffer from this streams control, if in
    * memory mode. This stream will be reset after this call.
    *
+   * @param  cap  Set to the capacity of the buffer in bytes, 0 if there is
+   * none. Can be nullptr.
    * @return  Pointer to this streams internal data buffer. If valid, you must
-   * free it.
+   * free it with get_allocator().deallocate(ptr, *cap), as allocators may need
+   * the size back. Returns nullptr if mapped.
+   */
+  void*        release(size_t* cap);
+
+  /**
+   * @return  Allocator used for the memory mode buffer. allocator::current()
+   * at construction, unless given to the constructor.
    */
-  void*        release();
+  allocator&   get_allocator() const;
 
   stream&      operator<<(const scl::string& str);
   stream&      operator>>(scl::string& str);
 };
 
+/**
+ * @brief  A window of `len` bytes of another stream, starting at `off`. Has
+ * its own rw pointer, and never reads or writes outside of the window. Reads
+ * and writes are positional reads and writes on the parent, so the parent's
+ * rw pointer does not move, and nothing is copied.
+ *
+ * Useful to hand out a section of a bigger stream, such as an entry of an
+ * archive, as a stream of its own. The window has a fixed size, writes past
+ * its end fail.
+ * @warning  The parent must outlive the substream.
+ */
+class substream : public stream {
+  stream*   m_parent = nullptr;
+  long long m_off    = 0;
+  long long m_pos    = 0;
+
+ protected:
+  bool passthrough() const override;
+
+ public:
+  substream() = default;
+
+  /**
+   * @param  parent  Stream to view. File, mapped, or memory mode.
+   * @param  off  Offset of the window in `parent`.
+   * @param  len  Size of the window in bytes.
+   */
+  substream(stream& parent, long long off, size_t len);
+
+  /**
+   * @brief  Points this substream at another window. Resets the rw pointer.
+   */
+  void      open(stream& parent, long long off, size_t len);
+
+  /**
+   * @return  The viewed stream, nullptr if closed.
+   */
+  stream*   parent() const;
+
+  /**
+   * @return  Offset of the window in the parent.
+   */
+  long long offset() const;
+
+  long long tell() const override;
+  long long seek(StreamPos pos, long long off) override;
+  using stream::read;
+  long long read(void* buf, size_t n) override;
+  long long read_at(long long off, void* buf, size_t n) override;
+  using stream::write;
+  bool      write(const void* buf, size_t n, size_t align = 1,
+         bool flush = false) override;
+  bool      write_at(long long off, const void* buf, size_t n) override;
+  bool      advise(Advice advice, long long off = 0, size_t len = 0) override;
+
+  /**
+   * @brief  Detaches from the parent. Does not close the parent.
+   */
+  void      close() override;
+};
+
+/**
+ * @brief  Memory stream made of fixed size chunks, instead of one contiguous
+ * buffer. Growing allocates a new chunk, and never moves what was written
+ * already, so building big outputs piece by piece costs one copy of each byte
+ * instead of one per reallocation.
+ *
+ * There is no contiguous view of the content until linearize() is called.
+ * read_all() and write_to() copy the chunks out directly.
+ */
+class chunk_stream : public stream {
+  struct block {
+    char*  ptr;
+    size_t size;
+  };
+
+  // Start of each chunk, in order. Point into m_blocks.
+  std::vector<char*> m_chunks;
+  // Allocations backing the chunks
+  std::vector<block> m_blocks;
+  size_t             m_chunk = 0;
+  size_t             m_pos   = 0;
+
+  bool               grow(size_t size);
+
+ protected:
+  bool passthrough() const override;
+
+ public:
+  /**
+   * @param  chunk  Size of each chunk in bytes.
+   */
+  chunk_stream(size_t chunk = SCL_CHUNK_SIZE);
+  ~chunk_stream() override;
+
+  chunk_stream(const chunk_stream&)            = delete;
+  chunk_stream& operator=(const chunk_stream&) = delete;
+
+  /**
+   * @brief  Moves the content into a single chunk, if it is not already.
+   *
+   * @return  Contiguous content of the stream, nullptr if empty. Valid until
+   * the stream grows or is closed.
+   */
+  const void* linearize();
+
+  /**
+   * @brief  Writes the whole content into `out`, one write per chunk. Does not
+   * move this stream's rw pointer.
+   *
+   * @return  false if a write failed.
+   */
+  bool        write_to(stream& out);
+
+  /**
+   * @brief  Reads from the rw pointer to the end into `out`, allocated once
+   * and filled chunk by chunk.
+   */
+  bool        read_all(scl::string& out, size_t max = -1) override;
+
+  long long   tell() const override;
+  long long   seek(StreamPos pos, long long off) override;
+  using stream::read;
+  long long   read(void* buf, size_t n) override;
+  long long   read_at(long long off, void* buf, size_t n) override;
+  using stream::write;
+  // align and flush do nothing, chunks are never padded nor flushed anywhere
+  bool        write(const void* buf, size_t n, size_t align = 1,
+           bool flush = false) override;
+  bool        write_at(long long off, const void* buf, size_t n) override;
+  void        flush() override;
+
+  /**
+   * @brief  Frees every chunk.
+   */
+  void        close() override;
+};
+
 namespace internal {
 class str_iterator {
   string*  m_s = nullptr;
@@ -617,5 +1631,12 @@ struct hash<scl::string> {
     return str.hash();
   }
 };
+
+template <>
+struct hash<scl::slice> {
+  size_t operator()(const scl::slice& str) const noexcept {
+    return str.hash();
+  }
+};
 } // namespace std
 #endif
@@ -21,19 +21,19 @@ struct hnode {
   T        m_data;
   uint32_t m_hash;
 };
-template <class T, class K, bool NC = true>
+template <class T, class K, bool NC = true, class Hfunc = string>
 class htab_iterator;
 } // namespace internal
 
 template <class T, class K = string, class Hfunc = string>
 class dictionary {
-  friend class internal::htab_iterator<T, K>;
-  friend class internal::htab_iterator<T, K, false>;
+  friend class internal::htab_iterator<T, K, true, Hfunc>;
+  friend class internal::htab_iterator<T, K, false, Hfunc>;
 
  protected:
   using hnode               = internal::hnode<T, K>;
-  using htab_iterator       = internal::htab_iterator<T, K, true>;
-  using const_htab_iterator = internal::htab_iterator<T, K, false>;
+  using htab_iterator       = internal::htab_iterator<T, K, true, Hfunc>;
+  using const_htab_iterator = internal::htab_iterator<T, K, false, Hfunc>;
 
   hnode**         m_ht      = nullptr;
   uint32_t        m_hnum    = 0;
@@ -390,21 +390,23 @@ class dictionary {
 };
 
 namespace internal {
-template <class T, class K, bool NC>
+template <class T, class K, bool NC, class Hfunc>
 class htab_iterator {
-  dictionary<T, K>* m_dict = nullptr;
-  K                 m_ikey;
-  uint32_t          m_hash = 0;
+  using dict_t = dictionary<T, K, Hfunc>;
+
+  dict_t*  m_dict = nullptr;
+  K        m_ikey;
+  uint32_t m_hash = 0;
 
  public:
   htab_iterator() = default;
 
-  htab_iterator(const dictionary<T, K>& dict, uint32_t hash)
-      : m_dict((dictionary<T, K>*)&dict), m_hash(hash) {
+  htab_iterator(const dict_t& dict, uint32_t hash)
+      : m_dict((dict_t*)&dict), m_hash(hash) {
   }
 
-  htab_iterator(const dictionary<T, K>& dict, uint32_t hash, const K& key)
-      : m_dict((dictionary<T, K>*)&dict), m_hash(hash), m_ikey(key) {
+  htab_iterator(const dict_t& dict, uint32_t hash, const K& key)
+      : m_dict((dict_t*)&dict), m_hash(hash), m_ikey(key) {
   }
 
   bool operator==(const htab_iterator& rhs) const {
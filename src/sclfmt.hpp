@@ -0,0 +1,311 @@
+/*  sclfmt.hpp
+ *  Compile time checked string formatting
+ */
+
+#ifndef SCL_FMT_H
+#define SCL_FMT_H
+
+#include <type_traits>
+#include <stdint.h>
+#include "sclcore.hpp"
+#include "sclnum.hpp"
+
+// Size of the stack buffer used when formatting into a stream, or an
+// scl::string.
+#ifndef SCL_FMT_BUF
+#  define SCL_FMT_BUF 256
+#endif
+
+/**
+ * @brief  Turns a string literal into a format string, which is parsed and
+ * checked against its arguments at compile time. Each {} is replaced by the
+ * next argument, {{ and }} write a literal brace.
+ * Ex: scl::format(SCL_FMT("{}_{}{}"), family, id, ext)
+ */
+#define SCL_FMT(str)                                 \
+  [] {                                               \
+    struct scl_fmt_str : scl::internal::fmt_string { \
+      static constexpr const char* get() {           \
+        return str;                                  \
+      }                                              \
+    };                                               \
+    return scl_fmt_str();                            \
+  }()
+
+namespace scl {
+namespace internal {
+struct fmt_string {};
+
+enum {
+  FMT_END,
+  FMT_ARG,
+  FMT_ESCAPE,
+  FMT_INVALID,
+};
+
+/* Index of the next brace at or after i, or the end of the string. */
+constexpr unsigned fmt_next(const char* s, unsigned i) {
+  while(s[i] && s[i] != '{' && s[i] != '}')
+    i++;
+  return i;
+}
+
+/* What the brace at i is. */
+constexpr int fmt_kind(const char* s, unsigned i) {
+  if(!s[i])
+    return FMT_END;
+  if(s[i] == '{' && s[i + 1] == '}')
+    return FMT_ARG;
+  if(s[i] == s[i + 1])
+    return FMT_ESCAPE;
+  return FMT_INVALID;
+}
+
+/* Number of {} in the format string. -1 if it has a stray brace. */
+constexpr int fmt_count(const char* s) {
+  int n = 0;
+  for(unsigned i = fmt_next(s, 0); s[i]; i = fmt_next(s, i + 2)) {
+    int k = fmt_kind(s, i);
+    if(k == FMT_INVALID)
+      return -1;
+    n += k == FMT_ARG;
+  }
+  return n;
+}
+
+template <int k>
+using fmt_kind_t = std::integral_constant<int, k>;
+
+/* Writes into a fixed size buffer, truncating. Keeps count of the full
+ * length. */
+class fmt_buffer {
+  char*  m_p;
+  char*  m_e;
+  size_t m_n = 0;
+
+ public:
+  fmt_buffer(char* buf, size_t n) : m_p(buf), m_e(buf + n) {
+  }
+
+  void put(const char* s, size_t n) {
+    size_t c = std::min(n, (size_t)(m_e - m_p));
+    memcpy(m_p, s, c);
+    m_p += c;
+    m_n += n;
+  }
+
+  char* pos() const {
+    return m_p;
+  }
+
+  size_t count() const {
+    return m_n;
+  }
+};
+
+/* Writes into a stream, through a stack buffer. */
+template <int align>
+class fmt_stream {
+  scl::stream& m_s;
+  char         m_buf[SCL_FMT_BUF];
+  unsigned     m_ln = 0;
+  bool         m_ok = true;
+
+ public:
+  fmt_stream(scl::stream& s) : m_s(s) {
+  }
+
+  void put(const char* s, size_t n) {
+    if(m_ln + n > SCL_FMT_BUF) {
+      flush();
+      if(n > SCL_FMT_BUF) {
+        m_ok = m_s.write(s, n, align) && m_ok;
+        return;
+      }
+    }
+    memcpy(m_buf + m_ln, s, n);
+    m_ln += (unsigned)n;
+  }
+
+  bool flush() {
+    if(m_ln)
+      m_ok = m_s.write(m_buf, m_ln, align) && m_ok;
+    m_ln = 0;
+    return m_ok;
+  }
+};
+
+template <class W>
+void fmt_arg(W& w, const char* v) {
+  if(v)
+    w.put(v, strlen(v));
+}
+
+template <class W>
+void fmt_arg(W& w, char* v) {
+  fmt_arg(w, (const char*)v);
+}
+
+template <class W>
+void fmt_arg(W& w, const scl::string& v) {
+  w.put(v.cstr(), v.len());
+}
+
+template <class W>
+void fmt_arg(W& w, const scl::slice& v) {
+  w.put(v.data(), v.len());
+}
+
+template <class W>
+void fmt_arg(W& w, char v) {
+  w.put(&v, 1);
+}
+
+template <class W>
+void fmt_arg(W& w, bool v) {
+  if(v)
+    w.put("true", 4);
+  else
+    w.put("false", 5);
+}
+
+template <class W, class T>
+typename std::enable_if<std::is_integral<T>::value &&
+                        std::is_signed<T>::value &&
+                        !std::is_same<T, char>::value>::type
+fmt_arg(W& w, T v) {
+  char  buf[SCL_INT_CHARS];
+  char* e = to_chars(buf, buf + SCL_INT_CHARS, (long long)v);
+  w.put(buf, e - buf);
+}
+
+template <class W, class T>
+typename std::enable_if<std::is_integral<T>::value &&
+                        std::is_unsigned<T>::value &&
+                        !std::is_same<T, bool>::value &&
+                        !std::is_same<T, char>::value>::type
+fmt_arg(W& w, T v) {
+  char  buf[SCL_INT_CHARS];
+  char* e = to_chars(buf, buf + SCL_INT_CHARS, (unsigned long long)v);
+  w.put(buf, e - buf);
+}
+
+template <class W, class T>
+typename std::enable_if<std::is_floating_point<T>::value>::type fmt_arg(W& w,
+  T v) {
+  char  buf[SCL_FLOAT_CHARS];
+  char* e = to_chars(buf, buf + SCL_FLOAT_CHARS, (double)v);
+  w.put(buf, e - buf);
+}
+
+template <class W>
+void fmt_arg(W& w, const void* v) {
+  char               buf[SCL_INT_CHARS + 2] = {'0', 'x'};
+  unsigned long long p                      = (uintptr_t)v;
+  char*              e = to_chars(buf + 2, buf + sizeof(buf), p, 16);
+  w.put(buf, e - buf);
+}
+
+template <class S, unsigned p, class W, class... A>
+void fmt_render(W& w, const A&... args);
+
+template <class S, unsigned p, class W>
+void fmt_render_at(W&, fmt_kind_t<FMT_END>) {
+}
+
+template <class S, unsigned p, class W, class... A>
+void fmt_render_at(W& w, fmt_kind_t<FMT_ESCAPE>, const A&... args) {
+  w.put(S::get() + p, 1);
+  fmt_render<S, p + 2>(w, args...);
+}
+
+template <class S, unsigned p, class W, class T, class... A>
+void fmt_render_at(W& w, fmt_kind_t<FMT_ARG>, const T& v, const A&... args) {
+  fmt_arg(w, v);
+  fmt_render<S, p + 2>(w, args...);
+}
+
+/* Writes the literal text up to the next brace, then handles the brace. All
+ * offsets are known at compile time. */
+template <class S, unsigned p, class W, class... A>
+void fmt_render(W& w, const A&... args) {
+  constexpr unsigned n = fmt_next(S::get(), p);
+  if(n > p)
+    w.put(S::get() + p, n - p);
+  fmt_render_at<S, n>(w, fmt_kind_t<fmt_kind(S::get(), n)>(), args...);
+}
+
+template <class S, class... A>
+void fmt_check() {
+  static_assert(std::is_base_of<fmt_string, S>::value,
+    "Format strings must be created with SCL_FMT()");
+  static_assert(fmt_count(S::get()) >= 0,
+    "Format string has an unmatched brace. Use {{ and }} for literal braces");
+  static_assert(fmt_count(S::get()) == sizeof...(A),
+    "Number of {} in format string does not match the number of arguments");
+}
+} // namespace internal
+
+/**
+ * @brief  Formats into a fixed size buffer. Output that does not fit is cut
+ * off. The output is always null terminated, as long as `n` is not 0.
+ *
+ * @param  buf  Buffer to format into.
+ * @param  n  Size of `buf` in bytes.
+ * @param  fmt  Format string, created with SCL_FMT().
+ * @param  args  Arguments to format.
+ * @return  Length of the full formatted string, excluding null terminator. If
+ * this is >= `n`, the output was cut off.
+ */
+template <class F, class... A>
+size_t format_to(char* buf, size_t n, F fmt, const A&... args) {
+  internal::fmt_check<F, A...>();
+  (void)fmt;
+  if(!n)
+    buf = nullptr;
+  internal::fmt_buffer w(buf, n ? n - 1 : 0);
+  internal::fmt_render<F, 0>(w, args...);
+  if(n)
+    *w.pos() = '\0';
+  return w.count();
+}
+
+/**
+ * @brief  Formats directly into a stream. Formatting goes through a stack
+ * buffer of SCL_FMT_BUF bytes, so no memory is allocated.
+ *
+ * @tparam  align  How to align reserve space. See scl::stream::write().
+ * @param  out  Stream to write to.
+ * @param  fmt  Format string, created with SCL_FMT().
+ * @param  args  Arguments to format.
+ * @return  true if all writes were successful.
+ */
+template <int align = 1, class F, class... A>
+bool format_to(scl::stream& out, F fmt, const A&... args) {
+  internal::fmt_check<F, A...>();
+  (void)fmt;
+  internal::fmt_stream<align> w(out);
+  internal::fmt_render<F, 0>(w, args...);
+  return w.flush();
+}
+
+/**
+ * @brief  Returns a formatted string. Short results are formatted on the stack,
+ * so only the returned string is allocated.
+ *
+ * @param  fmt  Format string, created with SCL_FMT().
+ * @param  args  Arguments to format.
+ */
+template <class F, class... A>
+scl::string format(F fmt, const A&... args) {
+  char   buf[SCL_FMT_BUF];
+  size_t n = format_to(buf, SCL_FMT_BUF, fmt, args...);
+  if(n < SCL_FMT_BUF)
+    return scl::slice(buf, (unsigned)n).copy();
+  scl::string out;
+  format_to(out.alloc((unsigned)n), n + 1, fmt, args...);
+  return out;
+}
+} // namespace scl
+
+#endif
@@ -0,0 +1,98 @@
+/*  sclhash.cpp
+ *  Checksumming stream
+ */
+
+#include "sclhash.hpp"
+#include "lz4/xxhash.h"
+
+namespace scl {
+hash_stream::hash_stream(stream& target, uint64_t seed) {
+  open(target, seed);
+}
+
+hash_stream::~hash_stream() {
+  if(m_state)
+    XXH64_freeState((XXH64_state_t*)m_state);
+}
+
+bool hash_stream::passthrough() const {
+  // Bytes live in the target
+  return false;
+}
+
+void hash_stream::open(stream& target, uint64_t seed) {
+  m_target = &target;
+  reset(seed);
+}
+
+stream* hash_stream::target() const {
+  return m_target;
+}
+
+void hash_stream::reset(uint64_t seed) {
+  if(!m_state) {
+    m_state = XXH64_createState();
+    if(!m_state)
+      throw "scl::hash_stream could not allocate its state";
+  }
+  XXH64_reset((XXH64_state_t*)m_state, seed);
+}
+
+uint64_t hash_stream::digest() const {
+  if(!m_state)
+    return 0;
+  return XXH64_digest((XXH64_state_t*)m_state);
+}
+
+long long hash_stream::tell() const {
+  return m_target ? m_target->tell() : 0;
+}
+
+long long hash_stream::seek(StreamPos pos, long long off) {
+  return m_target ? m_target->seek(pos, off) : 0;
+}
+
+long long hash_stream::read(void* buf, size_t n) {
+  if(!m_target)
+    return 0;
+  long long r = m_target->read(buf, n);
+  if(r > 0)
+    XXH64_update((XXH64_state_t*)m_state, buf, (size_t)r);
+  return r;
+}
+
+long long hash_stream::read_at(long long off, void* buf, size_t n) {
+  return m_target ? m_target->read_at(off, buf, n) : 0;
+}
+
+bool hash_stream::write(const void* buf, size_t n, size_t align, bool flush) {
+  if(!m_target || !buf)
+    return false;
+  // Hash and pass on one piece at a time, so big writes (a whole mapping, for
+  // example) are still in cache when the target gets them
+  const char* in = (const char*)buf;
+  while(n) {
+    size_t c = std::min(n, (size_t)SCL_STREAM_BUF);
+    XXH64_update((XXH64_state_t*)m_state, in, c);
+    if(!m_target->write(in, c, align, flush && c == n))
+      return false;
+    in += c;
+    n -= c;
+  }
+  m_modified = true;
+  return true;
+}
+
+bool hash_stream::write_at(long long off, const void* buf, size_t n) {
+  return m_target && m_target->write_at(off, buf, n);
+}
+
+void hash_stream::flush() {
+  if(m_target)
+    m_target->flush();
+}
+
+void hash_stream::close() {
+  m_target = nullptr;
+}
+} // namespace scl
@@ -0,0 +1,80 @@
+/*  sclhash.hpp
+ *  Checksumming stream
+ */
+
+#ifndef SCL_HASH_H
+#define SCL_HASH_H
+
+#include "sclcore.hpp"
+
+namespace scl {
+/**
+ * @brief  Passes reads and writes through to another stream, while hashing
+ * the bytes with XXH64. The checksum is computed as the data streams by, so
+ * there is no second pass over it.
+ *
+ * Bytes are hashed in the order they go through read() and write(). Seeking is
+ * forwarded to the target, and does not affect the hash. Positional reads and
+ * writes are forwarded without being hashed.
+ */
+class hash_stream : public stream {
+  stream* m_target = nullptr;
+  // XXH64 state, kept opaque so xxhash.h stays out of this header
+  void*   m_state  = nullptr;
+
+ protected:
+  bool passthrough() const override;
+
+ public:
+  hash_stream() = default;
+
+  /**
+   * @param  target  Stream to read from and write to. Not owned.
+   * @param  seed  XXH64 seed.
+   */
+  hash_stream(stream& target, uint64_t seed = 0);
+  ~hash_stream() override;
+
+  hash_stream(const hash_stream&)            = delete;
+  hash_stream& operator=(const hash_stream&) = delete;
+
+  /**
+   * @brief  Points this stream at another target, and resets the hash.
+   */
+  void      open(stream& target, uint64_t seed = 0);
+
+  /**
+   * @return  The target stream, nullptr if closed.
+   */
+  stream*   target() const;
+
+  /**
+   * @brief  Starts hashing over, without changing the target.
+   */
+  void      reset(uint64_t seed = 0);
+
+  /**
+   * @return  XXH64 of the bytes read and written since the last reset. Can be
+   * called at any time, hashing carries on after.
+   */
+  uint64_t  digest() const;
+
+  long long tell() const override;
+  long long seek(StreamPos pos, long long off) override;
+  using stream::read;
+  long long read(void* buf, size_t n) override;
+  long long read_at(long long off, void* buf, size_t n) override;
+  using stream::write;
+  bool      write(const void* buf, size_t n, size_t align = 1,
+         bool flush = false) override;
+  bool      write_at(long long off, const void* buf, size_t n) override;
+  void      flush() override;
+
+  /**
+   * @brief  Detaches from the target. Does not close the target.
+   */
+  void      close() override;
+};
+} // namespace scl
+
+#endif
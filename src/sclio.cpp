@@ -0,0 +1,382 @@
+/*  sclio.cpp
+ *  Asynchronous stream io
+ */
+
+#include "sclio.hpp"
+#include <chrono>
+#ifdef SCL_IO_URING
+#  include <atomic>
+#  include <unordered_set>
+#  include <errno.h>
+#  include <stdint.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <sys/uio.h>
+#  include <linux/io_uring.h>
+#endif
+
+namespace scl {
+namespace io {
+
+struct engine::request {
+  stream*   s;
+  int       fd;
+  bool      write;
+  long long off;
+  void*     buf;
+  size_t    n;
+  callback  cb;
+  // Bytes already transferred, when a short result is being completed
+  size_t    done = 0;
+#ifdef SCL_IO_URING
+  struct iovec iov = {};
+#endif
+};
+
+#ifdef SCL_IO_URING
+/* io_uring instance, set up with raw syscalls so liburing is not needed. */
+struct engine::ring {
+  int           fd       = -1;
+  unsigned      entries  = 0;
+  // Requests submitted to the kernel, and not reaped yet
+  unsigned      inflight = 0;
+  unsigned*     sq_head  = nullptr;
+  unsigned*     sq_tail  = nullptr;
+  unsigned*     sq_mask  = nullptr;
+  unsigned*     sq_array = nullptr;
+  io_uring_sqe* sqes     = (io_uring_sqe*)MAP_FAILED;
+  unsigned*     cq_head  = nullptr;
+  unsigned*     cq_tail  = nullptr;
+  unsigned*     cq_mask  = nullptr;
+  io_uring_cqe* cqes     = nullptr;
+  void*         sq_ptr   = MAP_FAILED;
+  void*         cq_ptr   = MAP_FAILED;
+  size_t        sq_sz    = 0;
+  size_t        cq_sz    = 0;
+  size_t        sqes_sz  = 0;
+
+  // Set once the ring failed, and must not be used anymore
+  std::atomic<bool>            dead{false};
+  // Requests in flight, so they can be handed elsewhere if the ring fails
+  std::unordered_set<request*> live;
+  // Whether waits can time out
+  bool                         ext_arg = false;
+
+  static ring*  setup(unsigned depth);
+  void          destroy();
+  bool          push(uint8_t op, int fd, long long off, struct iovec* iov,
+             void* data);
+  long          wait();
+};
+
+engine::ring* engine::ring::setup(unsigned depth) {
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+  // Not supported, or disallowed by the kernel
+  if(fd < 0)
+    return nullptr;
+  ring* r     = new ring();
+  r->fd       = fd;
+  r->entries  = p.sq_entries;
+#ifdef IORING_FEAT_EXT_ARG
+  r->ext_arg  = p.features & IORING_FEAT_EXT_ARG;
+#endif
+  r->sq_sz    = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_sz    = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+  if(single)
+    r->sq_sz = r->cq_sz = std::max(r->sq_sz, r->cq_sz);
+
+  r->sq_ptr = mmap(nullptr, r->sq_sz, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if(r->sq_ptr == MAP_FAILED) {
+    r->destroy();
+    return nullptr;
+  }
+  if(single)
+    r->cq_ptr = r->sq_ptr;
+  else
+    r->cq_ptr = mmap(nullptr, r->cq_sz, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  r->sqes_sz = p.sq_entries * sizeof(io_uring_sqe);
+  r->sqes    = (io_uring_sqe*)mmap(nullptr, r->sqes_sz, PROT_READ | PROT_WRITE,
+       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if(r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+    r->destroy();
+    return nullptr;
+  }
+
+  char* sq    = (char*)r->sq_ptr;
+  char* cq    = (char*)r->cq_ptr;
+  r->sq_head  = (unsigned*)(sq + p.sq_off.head);
+  r->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+  r->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned*)(sq + p.sq_off.array);
+  r->cq_head  = (unsigned*)(cq + p.cq_off.head);
+  r->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+  r->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+  r->cqes     = (io_uring_cqe*)(cq + p.cq_off.cqes);
+  return r;
+}
+
+void engine::ring::destroy() {
+  if(sqes != MAP_FAILED)
+    munmap(sqes, sqes_sz);
+  if(cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+    munmap(cq_ptr, cq_sz);
+  if(sq_ptr != MAP_FAILED)
+    munmap(sq_ptr, sq_sz);
+  if(fd >= 0)
+    close(fd);
+  delete this;
+}
+
+/* Queues one sqe, and submits it. Calls must be serialized. */
+bool engine::ring::push(uint8_t op, int fd, long long off, struct iovec* iov,
+  void* data) {
+  unsigned      tail = *sq_tail;
+  unsigned      idx  = tail & *sq_mask;
+  io_uring_sqe& sqe  = sqes[idx];
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode    = op;
+  sqe.fd        = fd;
+  sqe.off       = (uint64_t)off;
+  sqe.addr      = (uintptr_t)iov;
+  sqe.len       = iov ? 1 : 0;
+  sqe.user_data = (uintptr_t)data;
+  sq_array[idx] = idx;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  long ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, this->fd, 1, 0, 0, nullptr, 0);
+  } while(ret < 0 && errno == EINTR);
+  if(ret == 1)
+    return true;
+  // The kernel did not take it, so take it back
+  __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+  // Anything but the ring being busy means it is broken
+  if(ret < 0 && errno != EAGAIN && errno != EBUSY)
+    dead = true;
+  return false;
+}
+
+/* Waits for at least one completion. When the kernel supports it, gives up
+ * after a while, so the reaper notices a ring that was given up on. */
+long engine::ring::wait() {
+#ifdef IORING_ENTER_EXT_ARG
+  if(ext_arg) {
+    struct __kernel_timespec ts = {0, 100000000};
+    io_uring_getevents_arg   arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    return syscall(__NR_io_uring_enter, fd, 0, 1,
+      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+  }
+#endif
+  return syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS,
+    nullptr, 0);
+}
+#else
+struct engine::ring {};
+#endif
+
+engine::engine(jobs::JobServer* serv, unsigned depth) : m_serv(serv) {
+  if(!m_serv) {
+    m_pool = new jobs::JobServer(SCL_IO_THREADS);
+    m_pool->slow();
+    m_pool->start();
+  }
+#ifdef SCL_IO_URING
+  m_ring = ring::setup(depth);
+  if(m_ring)
+    m_reaper = std::thread(&engine::reap, this);
+#endif
+}
+
+engine::~engine() {
+  wait();
+#ifdef SCL_IO_URING
+  if(m_ring) {
+    // Wakes the reaper up, so it can see m_stop. Retried until the ring takes
+    // it. A broken ring is not woken up, its reaper returns by itself.
+    for(;;) {
+      {
+        std::lock_guard<std::mutex> lock(m_mux);
+        m_stop = true;
+        if(m_ring->dead)
+          break;
+        if(m_ring->push(IORING_OP_NOP, -1, 0, nullptr, nullptr)) {
+          m_ring->inflight++;
+          break;
+        }
+      }
+      waitms(1);
+    }
+    m_reaper.join();
+    m_ring->destroy();
+  }
+#endif
+  delete m_pool;
+}
+
+bool engine::uring() const {
+#ifdef SCL_IO_URING
+  return m_ring && !m_ring->dead;
+#else
+  return false;
+#endif
+}
+
+void engine::reap() {
+#ifdef SCL_IO_URING
+  ring& r = *m_ring;
+  for(;;) {
+    long ret = r.wait();
+    if(ret < 0 && errno != EINTR && errno != ETIME) {
+      // The ring is unusable. Stop using it, and hand what it still had to
+      // the job server, so nothing stays pending forever.
+      std::vector<request*> left;
+      {
+        std::lock_guard<std::mutex> lock(m_mux);
+        r.dead     = true;
+        r.inflight = 0;
+        left.assign(r.live.begin(), r.live.end());
+        r.live.clear();
+      }
+      for(request* req : left)
+        submit(req);
+      return;
+    }
+    unsigned head = *r.cq_head;
+    unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++) {
+      io_uring_cqe& cqe = r.cqes[head & *r.cq_mask];
+      request*      req = (request*)(uintptr_t)cqe.user_data;
+      long long     res = cqe.res;
+      // Hand the slot back before the callback runs, so it may submit more
+      __atomic_store_n(r.cq_head, head + 1, __ATOMIC_RELEASE);
+      {
+        std::lock_guard<std::mutex> lock(m_mux);
+        r.inflight--;
+        if(req)
+          r.live.erase(req);
+      }
+      if(req)
+        reaped(req, res);
+    }
+    std::lock_guard<std::mutex> lock(m_mux);
+    if((m_stop && !r.inflight) || (r.dead && r.live.empty()))
+      return;
+  }
+#endif
+}
+
+void engine::reaped(request* req, long long res) {
+  if(res < 0) {
+    finish(req, -1);
+    return;
+  }
+  // A read of 0 bytes is the end of the file, a write of 0 bytes is stuck
+  if(!res) {
+    finish(req, req->write ? -1 : (long long)req->done);
+    return;
+  }
+  req->done += res;
+  // Short read or write, go on with the rest like the fallback path would
+  if(req->done < req->n) {
+    submit(req);
+    return;
+  }
+  finish(req, req->done);
+}
+
+void engine::finish(request* req, long long result) {
+  if(req->cb)
+    req->cb(result);
+  delete req;
+  std::lock_guard<std::mutex> lock(m_mux);
+  m_pending--;
+  m_cv.notify_all();
+}
+
+bool engine::queue(request* req) {
+  {
+    std::lock_guard<std::mutex> lock(m_mux);
+    m_pending++;
+  }
+  submit(req);
+  return true;
+}
+
+void engine::submit(request* req) {
+  char*     buf = (char*)req->buf + req->done;
+  long long off = req->off + req->done;
+  size_t    n   = req->n - req->done;
+#ifdef SCL_IO_URING
+  {
+    std::lock_guard<std::mutex> lock(m_mux);
+    // Only file mode streams have something for the kernel to work on. If
+    // the ring is full, the request goes to the job server instead of
+    // blocking, since callbacks may submit requests themselves.
+    if(m_ring && !m_ring->dead && req->fd >= 0 &&
+       m_ring->inflight < m_ring->entries) {
+      req->iov.iov_base = buf;
+      req->iov.iov_len  = n;
+      m_ring->inflight++;
+      uint8_t op = req->write ? IORING_OP_WRITEV : IORING_OP_READV;
+      if(m_ring->push(op, req->fd, off, &req->iov, req)) {
+        m_ring->live.insert(req);
+        return;
+      }
+      m_ring->inflight--;
+    }
+  }
+#endif
+  jobs::JobServer* serv = m_serv ? m_serv : m_pool;
+  serv->submitJob([this, req, buf, off, n](const jobs::JobWorker&) {
+    long long r;
+    if(!req->write)
+      r = req->done + req->s->read_at(off, buf, n);
+    else if(req->s->write_at(off, buf, n))
+      r = req->n;
+    else
+      r = -1;
+    finish(req, r);
+  });
+}
+
+bool engine::read(stream& s, long long off, void* buf, size_t n,
+  callback cb) {
+  if(!buf || off < 0)
+    return false;
+  return queue(new request{&s, s.fd(), false, off, buf, n, std::move(cb)});
+}
+
+bool engine::write(stream& s, long long off, const void* buf, size_t n,
+  callback cb) {
+  if(!buf || off < 0)
+    return false;
+  return queue(
+    new request{&s, s.fd(), true, off, (void*)buf, n, std::move(cb)});
+}
+
+size_t engine::pending() {
+  std::lock_guard<std::mutex> lock(m_mux);
+  return m_pending;
+}
+
+bool engine::wait(double timeout) {
+  std::unique_lock<std::mutex> lock(m_mux);
+  auto                         done = [this]() {
+    return !m_pending;
+  };
+  if(timeout < 0) {
+    m_cv.wait(lock, done);
+    return true;
+  }
+  return m_cv.wait_for(lock, std::chrono::duration<double>(timeout), done);
+}
+} // namespace io
+} // namespace scl
@@ -0,0 +1,129 @@
+/*  sclio.hpp
+ *  Asynchronous stream io
+ */
+
+#ifndef SCL_IO_H
+#define SCL_IO_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "sclcore.hpp"
+#include "scljobs.hpp"
+
+// Max number of requests in flight on the io_uring backend.
+#ifndef SCL_IO_DEPTH
+#  define SCL_IO_DEPTH 64
+#endif
+
+// Number of threads of the fallback pool, when no job server is given.
+#ifndef SCL_IO_THREADS
+#  define SCL_IO_THREADS 4
+#endif
+
+#if defined(__linux__) && !defined(SCL_IO_NO_URING) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define SCL_IO_URING 1
+#  endif
+#endif
+
+namespace scl {
+namespace io {
+/**
+ * @brief  Called once a request completes, with the number of bytes
+ * transferred, or -1 if the request failed.
+ */
+using callback = std::function<void(long long result)>;
+
+/**
+ * @brief  Asynchronous io engine. Requests are submitted with read() and
+ * write(), and complete in the background, calling their callback.
+ *
+ * On Linux, file mode streams are read and written through io_uring, when
+ * the kernel allows it. Everything else runs as blocking read_at()/write_at()
+ * calls on a scl::jobs::JobServer.
+ * @note  Callbacks run on the engine's completion thread, or a job worker.
+ * Keep them short, and hand heavy work off to a job server.
+ */
+class engine {
+  struct request;
+  struct ring;
+
+  jobs::JobServer*        m_serv;
+  jobs::JobServer*        m_pool = nullptr;
+  ring*                   m_ring = nullptr;
+  std::thread             m_reaper;
+  std::mutex              m_mux;
+  std::condition_variable m_cv;
+  size_t                  m_pending = 0;
+  bool                    m_stop    = false;
+
+  bool                    queue(request* req);
+  // Hands a request, or what is left of it, to the ring or the job server
+  void                    submit(request* req);
+  // Completes a request reaped from the ring, resubmitting short results
+  void                    reaped(request* req, long long res);
+  void                    finish(request* req, long long result);
+  void                    reap();
+
+ public:
+  /**
+   * @brief  Creates an engine.
+   *
+   * @param  serv  Job server used by the fallback backend. If nullptr, the
+   * engine starts its own pool of SCL_IO_THREADS workers. Must be started, and
+   * outlive the engine.
+   * @param  depth  Max number of requests in flight on io_uring.
+   */
+  engine(jobs::JobServer* serv = nullptr, unsigned depth = SCL_IO_DEPTH);
+  ~engine();
+
+  engine(const engine&)            = delete;
+  engine& operator=(const engine&) = delete;
+
+  /**
+   * @return  true if requests on file mode streams go through io_uring.
+   */
+  bool    uring() const;
+
+  /**
+   * @brief  Submits a read of `n` raw bytes at `off` into `buf`. The stream's
+   * rw pointer is not used or moved.
+   * @warning  `s` and `buf` must stay valid until the callback is called.
+   * Buffered writes on `s` must be flushed before submitting.
+   *
+   * @return  true if the request was submitted. If false, the callback is
+   * never called.
+   */
+  bool    read(stream& s, long long off, void* buf, size_t n, callback cb);
+
+  /**
+   * @brief  Submits a write of `n` raw bytes from `buf` at `off`. The stream's
+   * rw pointer is not used or moved.
+   * @warning  `s` and `buf` must stay valid until the callback is called.
+   *
+   * @return  true if the request was submitted. If false, the callback is
+   * never called.
+   */
+  bool    write(stream& s, long long off, const void* buf, size_t n,
+       callback cb);
+
+  /**
+   * @return  Number of requests whose callback has not returned yet.
+   */
+  size_t  pending();
+
+  /**
+   * @brief  Waits for every submitted request to complete, and its callback
+   * to return.
+   *
+   * @param  timeout  Max number of seconds to wait. -1 waits forever.
+   * @return  false if the wait timed out.
+   */
+  bool    wait(double timeout = -1);
+};
+} // namespace io
+} // namespace scl
+
+#endif
@@ -0,0 +1,785 @@
+/*  sclnum.cpp
+ *  Numeric parsing and formatting
+ */
+
+#include "sclnum.hpp"
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+// Max number of significant digits kept while parsing a double. Any digit past
+// this only matters as a sticky bit, as the halfway point between two doubles
+// never has more than 767 significant digits.
+#define SCL_FLOAT_DIGITS 780
+
+/* clang-format off */
+// Value of each char as a digit (0-35), 255 if it isnt a digit.
+static const unsigned char digitvals[256] = {
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  0,1,2,3,4,5,6,7,8,9,255,255,255,255,255,255,
+  255,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,
+  25,26,27,28,29,30,31,32,33,34,35,255,255,255,255,255,
+  255,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,
+  25,26,27,28,29,30,31,32,33,34,35,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+};
+
+// Number of digits of each base that can never overflow a 64 bit integer.
+static const unsigned char safedigits[37] = {
+  0,0,64,40,32,27,24,22,21,20,19,18,17,17,16,16,16,15,15,15,14,14,14,14,13,13,
+  13,13,13,13,13,12,12,12,12,12,12,
+};
+
+static const char digitpairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char digitchars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+static const uint64_t pow10ints[20] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+  1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+  1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+  1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+// Powers of ten that are exactly representable as doubles.
+static const double pow10exact[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+  1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Normalized significands of 10^k, k = -348, -340, ..., 340 (for Grisu2).
+static const uint64_t cachedpowsF[87] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+// Binary exponents of cachedpowsF.
+static const int16_t cachedpowsE[87] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+  -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+  -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289, -263,
+  -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30, 56, 83, 109, 136,
+  162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508, 534,
+  561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853, 880, 907, 933,
+  960, 986, 1013, 1039, 1066,
+};
+
+// Normalized significands and exponents of 10^1 to 10^7.
+static const uint64_t adjpowsF[7] = {
+  0xa000000000000000ULL, 0xc800000000000000ULL, 0xfa00000000000000ULL,
+  0x9c40000000000000ULL, 0xc350000000000000ULL, 0xf424000000000000ULL,
+  0x9896800000000000ULL,
+};
+static const int adjpowsE[7] = {-60, -57, -54, -50, -47, -44, -40};
+/* clang-format on */
+
+#define DBL_HIDDEN_BIT  0x0010000000000000ULL
+#define DBL_SIGNIF_MASK 0x000fffffffffffffULL
+#define DBL_INF_BITS    0x7ff0000000000000ULL
+
+static uint64_t dbl_bits(double d) {
+  uint64_t u;
+  memcpy(&u, &d, sizeof(u));
+  return u;
+}
+
+static double dbl_from(uint64_t u) {
+  double d;
+  memcpy(&d, &u, sizeof(d));
+  return d;
+}
+
+static int clz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  while(!(x & 0x8000000000000000ULL))
+    x <<= 1, n++;
+  return n;
+#endif
+}
+
+static const char* parse_digits(const char* p, const char* last,
+  unsigned long long& out, int base, bool& overflow) {
+  // Detect base prefixes
+  if(!base) {
+    base = 10;
+    if(p != last && p[0] == '0' && p + 1 != last && (p[1] | 0x20) == 'x' &&
+       p + 2 != last && digitvals[(unsigned char)p[2]] < 16) {
+      base = 16;
+      p += 2;
+    }
+  }
+  if(base < 2 || base > 36)
+    return p;
+  unsigned long long v = 0;
+  // Digits that cannot overflow, no checks necessary
+  for(int i = safedigits[base]; i && p != last; i--, p++) {
+    unsigned d = digitvals[(unsigned char)*p];
+    if(d >= (unsigned)base)
+      break;
+    v = v * base + d;
+  }
+  for(; p != last; p++) {
+    unsigned d = digitvals[(unsigned char)*p];
+    if(d >= (unsigned)base)
+      break;
+    if(v > (~0ULL - d) / base)
+      overflow = true;
+    else
+      v = v * base + d;
+  }
+  out = overflow ? ~0ULL : v;
+  return p;
+}
+
+namespace {
+/* Just enough of an arbitrary precision integer to correctly round doubles
+ * that miss the fast path. */
+class bigint {
+  // 5120 bits, fits SCL_FLOAT_DIGITS digits scaled to any double exponent.
+  uint32_t m_w[160];
+  int      m_n = 0;
+
+ public:
+  bigint(uint64_t v = 0) {
+    m_w[0] = (uint32_t)v;
+    m_w[1] = (uint32_t)(v >> 32);
+    m_n    = m_w[1] ? 2 : !!m_w[0];
+  }
+
+  void mul(uint32_t m) {
+    uint64_t carry = 0;
+    for(int i = 0; i < m_n; i++) {
+      uint64_t t = (uint64_t)m_w[i] * m + carry;
+      m_w[i]     = (uint32_t)t;
+      carry      = t >> 32;
+    }
+    if(carry)
+      m_w[m_n++] = (uint32_t)carry;
+  }
+
+  void add(uint32_t a) {
+    uint64_t carry = a;
+    for(int i = 0; carry && i < m_n; i++) {
+      uint64_t t = (uint64_t)m_w[i] + carry;
+      m_w[i]     = (uint32_t)t;
+      carry      = t >> 32;
+    }
+    if(carry)
+      m_w[m_n++] = (uint32_t)carry;
+  }
+
+  void mulpow5(int e) {
+    // 5^13 is the largest power of 5 that fits in 32 bits
+    for(; e >= 13; e -= 13)
+      mul(1220703125u);
+    if(e)
+      mul((uint32_t)(pow10ints[e] >> e));
+  }
+
+  void shl(int s) {
+    if(!m_n)
+      return;
+    const int ws = s >> 5, bs = s & 31;
+    if(bs) {
+      uint32_t carry = 0;
+      for(int i = 0; i < m_n; i++) {
+        uint32_t t = m_w[i];
+        m_w[i]     = (t << bs) | carry;
+        carry      = t >> (32 - bs);
+      }
+      if(carry)
+        m_w[m_n++] = carry;
+    }
+    if(ws) {
+      memmove(m_w + ws, m_w, sizeof(uint32_t) * m_n);
+      memset(m_w, 0, sizeof(uint32_t) * ws);
+      m_n += ws;
+    }
+  }
+
+  int cmp(const bigint& rhs) const {
+    if(m_n != rhs.m_n)
+      return m_n < rhs.m_n ? -1 : 1;
+    for(int i = m_n - 1; i >= 0; i--) {
+      if(m_w[i] != rhs.m_w[i])
+        return m_w[i] < rhs.m_w[i] ? -1 : 1;
+    }
+    return 0;
+  }
+};
+
+/* 64 bit significand with a binary exponent, used by Grisu2. */
+struct diyfp {
+  uint64_t f;
+  int      e;
+
+  diyfp(uint64_t f = 0, int e = 0) : f(f), e(e) {
+  }
+
+  explicit diyfp(double d) {
+    const uint64_t u  = dbl_bits(d);
+    const int      be = (int)((u >> 52) & 0x7ff);
+    f                 = u & DBL_SIGNIF_MASK;
+    if(be) {
+      f += DBL_HIDDEN_BIT;
+      e = be - 1075;
+    } else
+      e = -1074;
+  }
+
+  diyfp operator-(const diyfp& rhs) const {
+    return diyfp(f - rhs.f, e);
+  }
+
+  diyfp operator*(const diyfp& rhs) const {
+    const uint64_t M32 = 0xffffffffULL;
+    const uint64_t a = f >> 32, b = f & M32, c = rhs.f >> 32, d = rhs.f & M32;
+    const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t       tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    // Round
+    tmp += 1ULL << 31;
+    return diyfp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+  }
+
+  diyfp normalize() const {
+    const int s = clz64(f);
+    return diyfp(f << s, e - s);
+  }
+
+  void boundaries(diyfp& minus, diyfp& plus) const {
+    plus = diyfp((f << 1) + 1, e - 1).normalize();
+    // The lower boundary is closer when at a power of two
+    minus = f == DBL_HIDDEN_BIT ? diyfp((f << 2) - 1, e - 2)
+                                : diyfp((f << 1) - 1, e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+  }
+};
+} // namespace
+
+static void grisu_round(char* buf, int len, uint64_t delta, uint64_t rest,
+  uint64_t tenk, uint64_t wpw) {
+  while(rest < wpw && delta - rest >= tenk &&
+        (rest + tenk < wpw || wpw - rest > rest + tenk - wpw)) {
+    buf[len - 1]--;
+    rest += tenk;
+  }
+}
+
+static int count_digits32(uint32_t n) {
+  int d = 1;
+  while(d < 10 && n >= pow10ints[d])
+    d++;
+  return d;
+}
+
+static void grisu_digits(const diyfp& W, const diyfp& Mp, uint64_t delta,
+  char* buf, int& len, int& K) {
+  const diyfp one(1ULL << -Mp.e, Mp.e);
+  const diyfp wpw   = Mp - W;
+  uint32_t    p1    = (uint32_t)(Mp.f >> -one.e);
+  uint64_t    p2    = Mp.f & (one.f - 1);
+  int         kappa = count_digits32(p1);
+  len               = 0;
+  while(kappa > 0) {
+    const uint32_t div = (uint32_t)pow10ints[kappa - 1];
+    const uint32_t d   = p1 / div;
+    p1 %= div;
+    if(d || len)
+      buf[len++] = (char)('0' + d);
+    kappa--;
+    const uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+    if(tmp <= delta) {
+      K += kappa;
+      grisu_round(buf, len, delta, tmp, pow10ints[kappa] << -one.e, wpw.f);
+      return;
+    }
+  }
+  for(;;) {
+    p2 *= 10;
+    delta *= 10;
+    const char d = (char)(p2 >> -one.e);
+    if(d || len)
+      buf[len++] = (char)('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+    if(p2 < delta) {
+      K += kappa;
+      grisu_round(buf, len, delta, p2, one.f,
+        -kappa < 20 ? wpw.f * pow10ints[-kappa] : 0);
+      return;
+    }
+  }
+}
+
+// Writes the shortest (mostly) digits of positive v to buf, v = buf * 10^K
+static void grisu2(double v, char* buf, int& len, int& K) {
+  const diyfp dv(v);
+  diyfp       wm, wp;
+  dv.boundaries(wm, wp);
+  // Find a cached power of ten c, so that wp * c lands in [2^-60, 2^-32)
+  const double dk = (-61 - wp.e) * 0.30102999566398114 + 347;
+  int          k  = (int)dk;
+  if(dk - k > 0.0)
+    k++;
+  const unsigned idx = (unsigned)((k >> 3) + 1);
+  K                  = -(-348 + (int)(idx << 3));
+  const diyfp c(cachedpowsF[idx], cachedpowsE[idx]);
+  const diyfp W  = dv.normalize() * c;
+  diyfp       Wp = wp * c;
+  diyfp       Wm = wm * c;
+  Wm.f++;
+  Wp.f--;
+  grisu_digits(W, Wp, Wp.f - Wm.f, buf, len, K);
+}
+
+static char* write_exponent(char* o, int e) {
+  *o++ = 'e';
+  *o++ = e < 0 ? '-' : '+';
+  if(e < 0)
+    e = -e;
+  if(e >= 100) {
+    *o++ = (char)('0' + e / 100);
+    e %= 100;
+    memcpy(o, digitpairs + e * 2, 2);
+    return o + 2;
+  }
+  if(e >= 10) {
+    memcpy(o, digitpairs + e * 2, 2);
+    return o + 2;
+  }
+  *o++ = (char)('0' + e);
+  return o;
+}
+
+// Lays out len digits with decimal exponent K
+static char* prettify(char* o, const char* digits, int len, int K) {
+  // 10^(kk-1) <= v < 10^kk
+  const int kk = len + K;
+  if(len <= kk && kk <= 21) {
+    // 1234e7 => 12340000000
+    memcpy(o, digits, len);
+    memset(o + len, '0', kk - len);
+    return o + kk;
+  } else if(0 < kk && kk <= 21) {
+    // 1234e-2 => 12.34
+    memcpy(o, digits, kk);
+    o[kk] = '.';
+    memcpy(o + kk + 1, digits + kk, len - kk);
+    return o + len + 1;
+  } else if(-6 < kk && kk <= 0) {
+    // 1234e-6 => 0.001234
+    const int off = 2 - kk;
+    o[0]          = '0';
+    o[1]          = '.';
+    memset(o + 2, '0', -kk);
+    memcpy(o + off, digits, len);
+    return o + off + len;
+  }
+  // 1234e30 => 1.234e+33
+  *o++ = digits[0];
+  if(len > 1) {
+    *o++ = '.';
+    memcpy(o, digits + 1, len - 1);
+    o += len - 1;
+  }
+  return write_exponent(o, kk - 1);
+}
+
+static double diyfp_double(uint64_t f, int e) {
+  while(f > DBL_HIDDEN_BIT + DBL_SIGNIF_MASK)
+    f >>= 1, e++;
+  if(e >= 972)
+    return dbl_from(DBL_INF_BITS);
+  if(e < -1074)
+    return 0.0;
+  while(e > -1074 && !(f & DBL_HIDDEN_BIT))
+    f <<= 1, e--;
+  const uint64_t be =
+    (e == -1074 && !(f & DBL_HIDDEN_BIT)) ? 0 : (uint64_t)(e + 1075);
+  return dbl_from((f & DBL_SIGNIF_MASK) | (be << 52));
+}
+
+/* Computes w * 10^e10 in extended precision, keeping track of the error (see
+ * double-conversion's DiyFpStrtod). w holds the first digits of n, rounded.
+ * Returns false if the error is too big to be sure of the rounding, in which
+ * case r is either correct, or one ulp too low. */
+static bool diyfp_float(uint64_t w, int n, int e10, double& r) {
+  const int denomlog = 3, denom = 1 << denomlog;
+  // Digits that didnt fit into w
+  const int remaining = n > 19 ? n - 19 : 0;
+  e10 += remaining;
+  uint64_t error = remaining ? denom / 2 : 0;
+  diyfp    in    = diyfp(w, 0).normalize();
+  error <<= -in.e;
+
+  // Scale by a cached power, and adjust for the gap between cached powers
+  const int idx = (e10 + 348) / 8;
+  const int adj = e10 - (-348 + idx * 8);
+  if(adj) {
+    in = in * diyfp(adjpowsF[adj - 1], adjpowsE[adj - 1]);
+    // Exact if the product fits in 64 bits
+    if(19 - n < adj)
+      error += denom / 2;
+  }
+  in = in * diyfp(cachedpowsF[idx], cachedpowsE[idx]);
+  error += denom / 2 + (error ? 1 : 0) + denom / 2;
+  int olde = in.e;
+  in       = in.normalize();
+  error <<= olde - in.e;
+
+  // Number of bits that get rounded off, more for denormals
+  const int order   = 64 + in.e;
+  const int sigsize = order >= -1074 + 53 ? 53
+                    : order <= -1074      ? 0
+                                          : order + 1074;
+  int       prec    = 64 - sigsize;
+  if(prec + denomlog >= 64) {
+    const int shift = prec + denomlog - 64 + 1;
+    in.f >>= shift;
+    in.e += shift;
+    error = (error >> shift) + 1 + denom;
+    prec -= shift;
+  }
+  const uint64_t precbits = (in.f & ((1ULL << prec) - 1)) * denom;
+  const uint64_t half     = (1ULL << (prec - 1)) * denom;
+  uint64_t       f        = in.f >> prec;
+  if(precbits >= half + error)
+    f++;
+  r = diyfp_double(f, in.e + prec);
+  return precbits <= half - error || precbits >= half + error;
+}
+
+// Compares d * 10^e10 with m * 2^e2
+static int cmp_scaled(const bigint& d, int e10, uint64_t m, int e2) {
+  bigint l = d, r(m);
+  if(e10 >= 0)
+    l.mulpow5(e10), l.shl(e10);
+  else
+    r.mulpow5(-e10), r.shl(-e10);
+  if(e2 >= 0)
+    r.shl(e2);
+  else
+    l.shl(-e2);
+  return l.cmp(r);
+}
+
+// Correctly rounds digits * 10^e10, starting from a close guess
+static double slow_float(const char* digits, int nd, int e10, double guess) {
+  bigint d;
+  for(int i = 0; i < nd;) {
+    // Up to 9 digits at a time
+    uint32_t chunk = 0;
+    int      n     = 0;
+    for(; n < 9 && i < nd; n++, i++)
+      chunk = chunk * 10 + digits[i];
+    d.mul((uint32_t)pow10ints[n]);
+    d.add(chunk);
+  }
+  uint64_t bits = dbl_bits(guess);
+  if(bits >= DBL_INF_BITS)
+    bits = DBL_INF_BITS - 1;
+  for(;;) {
+    const int be = (int)(bits >> 52);
+    uint64_t  m  = bits & DBL_SIGNIF_MASK;
+    int       k  = -1074;
+    if(be) {
+      m |= DBL_HIDDEN_BIT;
+      k = be - 1075;
+    }
+    // Above the upper halfway point, or on it and odd
+    int c = cmp_scaled(d, e10, 2 * m + 1, k - 1);
+    if(c > 0 || (!c && (m & 1))) {
+      if(++bits == DBL_INF_BITS)
+        break;
+      continue;
+    }
+    if(!m)
+      break;
+    // Below the lower halfway point, or on it and odd
+    if(m == DBL_HIDDEN_BIT && be > 1)
+      c = cmp_scaled(d, e10, 4 * m - 1, k - 2);
+    else
+      c = cmp_scaled(d, e10, 2 * m - 1, k - 1);
+    if(c < 0 || (!c && (m & 1))) {
+      bits--;
+      continue;
+    }
+    break;
+  }
+  return dbl_from(bits);
+}
+
+// Case insensitive match of a lowercase word
+static bool match_word(const char* p, const char* last, const char* word) {
+  for(; *word; p++, word++) {
+    if(p == last || (*p | 0x20) != *word)
+      return false;
+  }
+  return true;
+}
+
+namespace scl {
+const char* from_chars(const char* first, const char* last,
+  unsigned long long& value, int base) {
+  const char* p = first;
+  if(p != last && *p == '+')
+    p++;
+  bool               overflow = false;
+  unsigned long long v;
+  const char*        e = parse_digits(p, last, v, base, overflow);
+  if(e == p)
+    return first;
+  value = v;
+  return e;
+}
+
+const char* from_chars(const char* first, const char* last, long long& value,
+  int base) {
+  const char* p   = first;
+  bool        neg = false;
+  if(p != last && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+  bool               overflow = false;
+  unsigned long long v;
+  const char*        e = parse_digits(p, last, v, base, overflow);
+  if(e == p)
+    return first;
+  const unsigned long long limit = neg ? 0x8000000000000000ULL : LLONG_MAX;
+  if(v > limit)
+    v = limit;
+  value = neg ? (long long)(0 - v) : (long long)v;
+  return e;
+}
+
+const char* from_chars(const char* first, const char* last, double& value) {
+  const char* p   = first;
+  bool        neg = false;
+  if(p != last && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+  if(p != last && digitvals[(unsigned char)*p] > 9 && *p != '.') {
+    double r;
+    if(match_word(p, last, "inf")) {
+      r = dbl_from(DBL_INF_BITS);
+      p += match_word(p + 3, last, "inity") ? 8 : 3;
+    } else if(match_word(p, last, "nan")) {
+      r = dbl_from(0x7ff8000000000000ULL);
+      p += 3;
+    } else
+      return first;
+    value = neg ? -r : r;
+    return p;
+  }
+
+  char     digits[SCL_FLOAT_DIGITS + 1];
+  uint64_t w      = 0;
+  int      nd     = 0;
+  int      e10    = 0;
+  bool     sticky = false;
+  bool     any    = false;
+  bool     frac   = false;
+  for(;; p++) {
+    if(p == last)
+      break;
+    unsigned d = (unsigned char)*p - '0';
+    if(d > 9) {
+      if(*p != '.' || frac)
+        break;
+      frac = true;
+      continue;
+    }
+    any = true;
+    // Skip leading zeros
+    if(!nd && !d) {
+      e10 -= frac;
+      continue;
+    }
+    if(nd < 19)
+      w = w * 10 + d;
+    if(nd < SCL_FLOAT_DIGITS)
+      digits[nd] = (char)d;
+    else if(d)
+      sticky = true;
+    nd++;
+    e10 -= frac;
+  }
+  if(!any)
+    return first;
+
+  if(p != last && (*p | 0x20) == 'e') {
+    const char* q    = p + 1;
+    bool        eneg = false;
+    if(q != last && (*q == '-' || *q == '+'))
+      eneg = *q++ == '-';
+    if(q != last && (unsigned)((unsigned char)*q - '0') <= 9) {
+      int      ex = 0;
+      unsigned d;
+      for(; q != last && (d = (unsigned char)*q - '0') <= 9; q++) {
+        // Any bigger and the result is inf or 0 anyways
+        if(ex < 100000)
+          ex = ex * 10 + d;
+      }
+      e10 += eneg ? -ex : ex;
+      p = q;
+    }
+  }
+
+  // Digits past SCL_FLOAT_DIGITS only matter as a sticky digit
+  int n = nd < SCL_FLOAT_DIGITS ? nd : SCL_FLOAT_DIGITS;
+  e10 += nd - n;
+  if(sticky)
+    digits[n++] = 1, e10--;
+  // Trailing zeros just scale the exponent
+  while(n && !digits[n - 1])
+    n--, e10++;
+  if(n < nd && n <= 19)
+    w /= pow10ints[(nd < 19 ? nd : 19) - n];
+
+  double r;
+  if(!n)
+    r = 0.0;
+  else if(n + e10 > 310)
+    r = dbl_from(DBL_INF_BITS);
+  else if(n + e10 < -324)
+    r = 0.0;
+  else if(n <= 19 && w <= (1ULL << 53) && e10 >= -22 && e10 <= 22)
+    // Exact operands, one rounding
+    r = e10 < 0 ? (double)w / pow10exact[-e10] : (double)w * pow10exact[e10];
+  else if(n <= 19 && e10 > 22 && e10 <= 22 + 15 &&
+          w <= (1ULL << 53) / pow10ints[e10 - 22])
+    r = (double)(w * pow10ints[e10 - 22]) * 1e22;
+  else {
+    // Round w if digits got cut off
+    if(n > 19 && digits[19] >= 5)
+      w++;
+    if(!diyfp_float(w, n, e10, r))
+      // Too close to a halfway point, correct with big integers
+      r = slow_float(digits, n, e10, r);
+  }
+  value = neg ? -r : r;
+  return p;
+}
+
+char* to_chars(char* first, char* last, unsigned long long value, int base) {
+  if(base < 2 || base > 36)
+    return nullptr;
+  char  buf[SCL_INT_CHARS];
+  char* p = buf + sizeof(buf);
+  if(base == 10) {
+    // Two digits at a time
+    while(value >= 100) {
+      const unsigned i = (unsigned)(value % 100) * 2;
+      value /= 100;
+      p -= 2;
+      memcpy(p, digitpairs + i, 2);
+    }
+    if(value >= 10) {
+      p -= 2;
+      memcpy(p, digitpairs + value * 2, 2);
+    } else
+      *--p = (char)('0' + value);
+  } else {
+    do {
+      *--p = digitchars[value % base];
+      value /= base;
+    } while(value);
+  }
+  const size_t n = buf + sizeof(buf) - p;
+  if((size_t)(last - first) < n)
+    return nullptr;
+  memcpy(first, p, n);
+  return first + n;
+}
+
+char* to_chars(char* first, char* last, long long value, int base) {
+  if(value >= 0)
+    return to_chars(first, last, (unsigned long long)value, base);
+  if(first == last)
+    return nullptr;
+  *first = '-';
+  return to_chars(first + 1, last, 0 - (unsigned long long)value, base);
+}
+
+char* to_chars(char* first, char* last, double value) {
+  char           buf[SCL_FLOAT_CHARS];
+  char*          o    = buf;
+  const uint64_t bits = dbl_bits(value);
+  if((bits & DBL_INF_BITS) == DBL_INF_BITS) {
+    if(bits & DBL_SIGNIF_MASK) {
+      memcpy(o, "nan", 3);
+      o += 3;
+    } else {
+      if(bits >> 63)
+        *o++ = '-';
+      memcpy(o, "inf", 3);
+      o += 3;
+    }
+  } else {
+    if(bits >> 63)
+      *o++ = '-';
+    if(!(bits << 1))
+      *o++ = '0';
+    else {
+      char digits[18];
+      int  len, K;
+      grisu2(fabs(value), digits, len, K);
+      o = prettify(o, digits, len, K);
+    }
+  }
+  const size_t n = o - buf;
+  if((size_t)(last - first) < n)
+    return nullptr;
+  memcpy(first, buf, n);
+  return first + n;
+}
+} // namespace scl
@@ -0,0 +1,92 @@
+/*  sclnum.hpp
+ *  Numeric parsing and formatting
+ */
+
+#ifndef SCL_NUM_H
+#define SCL_NUM_H
+
+#include <stdint.h>
+
+// Max number of chars to_chars() can write for an integer (base 2, and sign).
+#define SCL_INT_CHARS   66
+// Max number of chars to_chars() can write for a double.
+#define SCL_FLOAT_CHARS 32
+
+namespace scl {
+/**
+ * @brief  Parses an integer from [first, last). Accepts an optional sign. No
+ * whitespace is skipped, and parsing is locale independent.
+ * @note  Saturates to the min/max value of the output type on overflow.
+ *
+ * @param  first  Start of the characters to parse.
+ * @param  last  One past the end of the characters to parse. May be nullptr,
+ * in which case parsing stops at the null terminator.
+ * @param  value  Set to the parsed value. Untouched if nothing was parsed.
+ * @param  base  Base of the integer, from 2 to 36. If 0, a 0x/0X prefix
+ * selects base 16, otherwise base 10 is used.
+ * @return  Pointer to one past the last parsed char. `first` if no integer
+ * could be parsed.
+ */
+const char* from_chars(const char* first, const char* last, long long& value,
+  int base = 10);
+
+/**
+ * @brief  Unsigned version of from_chars(). A '-' sign is not accepted.
+ * For more info, see from_chars().
+ */
+const char* from_chars(const char* first, const char* last,
+  unsigned long long& value, int base = 10);
+
+/**
+ * @brief  Parses a double from [first, last). Accepts an optional sign,
+ * decimal and scientific notation, inf, infinity, and nan. No whitespace is
+ * skipped, and parsing is locale independent.
+ * @note  The result is correctly rounded, so any string produced by to_chars()
+ * will parse back into the exact same double. Out of range values become
+ * +-inf, or +-0.
+ *
+ * @param  first  Start of the characters to parse.
+ * @param  last  One past the end of the characters to parse. May be nullptr,
+ * in which case parsing stops at the null terminator.
+ * @param  value  Set to the parsed value. Untouched if nothing was parsed.
+ * @return  Pointer to one past the last parsed char. `first` if no number
+ * could be parsed.
+ */
+const char* from_chars(const char* first, const char* last, double& value);
+
+/**
+ * @brief  Formats an integer into [first, last). Does not null terminate.
+ *
+ * @param  first  Start of the output buffer.
+ * @param  last  One past the end of the output buffer. SCL_INT_CHARS bytes is
+ * always enough.
+ * @param  value  Value to format.
+ * @param  base  Base to format in, from 2 to 36.
+ * @return  Pointer to one past the last written char. nullptr if the buffer is
+ * too small.
+ */
+char* to_chars(char* first, char* last, long long value, int base = 10);
+
+/**
+ * @brief  Unsigned version of to_chars(). For more info, see to_chars().
+ */
+char* to_chars(char* first, char* last, unsigned long long value,
+  int base = 10);
+
+/**
+ * @brief  Formats a double into [first, last), using the fewest digits
+ * (Grisu2) needed for from_chars() to parse back the exact same value. Does not
+ * null terminate, and is locale independent.
+ * Ex: 0.1 => "0.1", 1e21 => "1e+21", 1.5e-7 => "1.5e-7"
+ *
+ * @param  first  Start of the output buffer.
+ * @param  last  One past the end of the output buffer. SCL_FLOAT_CHARS bytes
+ * is always enough.
+ * @param  value  Value to format.
+ * @return  Pointer to one past the last written char. nullptr if the buffer is
+ * too small.
+ */
+char* to_chars(char* first, char* last, double value);
+} // namespace scl
+
+#endif
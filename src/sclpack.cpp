@@ -3,6 +3,9 @@
  */
 
 #include "sclpack.hpp"
+#include "sclfmt.hpp"
+#include "sclhash.hpp"
+#include "sclprof.hpp"
 #include <cassert>
 
 #define SPK_MAJOR       2
@@ -23,12 +26,6 @@
 #  define SPK_MAX_PACK_SIZE 0xffffffff
 #endif
 
-bool is_little_endiann() {
-  volatile uint32_t i = 0x01234567;
-  // return 0 for big endian, 1 for little endian.
-  return (*((uint8_t*)(&i))) == 0x67;
-}
-
 namespace scl {
 namespace pack {
 
@@ -39,7 +36,7 @@ PackWaitable::PackWaitable(scl::stream* stream) {
 PackIndex::PackIndex(const scl::string& file) : m_file(file) {
 }
 
-PackIndex::PackIndex(PackIndex&& rhs) : m_file(rhs.m_file) {
+PackIndex::PackIndex(PackIndex&& rhs) : m_file(std::move(rhs.m_file)) {
   m_wt        = std::move(rhs.m_wt);
   m_family    = rhs.m_family;
   m_off       = rhs.m_off;
@@ -48,18 +45,20 @@ PackIndex::PackIndex(PackIndex&& rhs) : m_file(rhs.m_file) {
   m_active    = rhs.m_active;
   m_submitted = rhs.m_submitted;
   m_pack      = rhs.m_pack;
+  m_hash      = rhs.m_hash;
 }
 
 PackIndex& PackIndex::operator=(PackIndex&& rhs) {
   m_wt        = std::move(rhs.m_wt);
   m_family    = rhs.m_family;
-  m_file      = rhs.m_file;
+  m_file      = std::move(rhs.m_file);
   m_off       = rhs.m_off;
   m_size      = rhs.m_size;
   m_original  = rhs.m_original;
   m_active    = rhs.m_active;
   m_submitted = rhs.m_submitted;
   m_pack      = rhs.m_pack;
+  m_hash      = rhs.m_hash;
   return *this;
 }
 
@@ -106,45 +105,38 @@ PackWaitable* PackFetchJob::getWaitable() const {
   return &m_idx.m_wt;
 }
 
-PackFetchJob::PackFetchJob(PackIndex& idx, Packager& pack)
-    : m_idx(idx), m_pack(pack) {
+PackFetchJob::PackFetchJob(PackIndex& idx, Packager& pack, char* src,
+  long long read)
+    : m_idx(idx), m_pack(pack), m_src(src), m_read(read) {
 }
 
-bool PackFetchJob::checkJob(const jobs::JobWorker& worker) const {
-  size_t           bits = 1llu << m_idx.m_pack;
-  jobs::JobServer& serv = worker.serv();
-  // Is the target stream locked?
-  if(serv.hasLockBits(bits))
-    return false;
-  // Lock target stream bit
-  serv.setLockBits(bits);
-  return true;
+PackFetchJob::~PackFetchJob() {
+  delete[] m_src;
 }
 
 void PackFetchJob::doJob(PackWaitable* wt, const jobs::JobWorker& worker) {
-  // Target stream lock bit
-  size_t              bits    = 1llu << m_idx.m_pack;
-  scl::reduce_stream* archive = m_pack.m_archives[m_idx.m_pack];
-  scl::stream*        out     = m_idx.m_wt.m_stream;
-  archive->seek(StreamPos::start, m_idx.m_off);
-  // Begin decompression stream
-  if(!archive->begin(reduce_stream::Decompress))
-    return;
+  scl::stream* out = m_idx.m_wt.m_stream;
+  long long    r   = m_read;
   // Decompress into m_out, with a max byte count of m_idx.m_original
   out->reserve(m_idx.m_original);
-  if(!out->write(*archive, m_idx.m_original))
+  // Hash the output as it is written, while it is still in cache
+  scl::hash_stream tee(*out);
+  if(r == m_idx.m_size)
+    r = reduce_stream::decompress(m_src, m_idx.m_size, tee,
+      m_idx.m_original);
+  delete[] m_src;
+  m_src = nullptr;
+  if(r < 0)
     return;
+  m_idx.m_hash = tee.digest();
   // Reset modified status, so later code works properly
   out->reset_modified();
-  // End decompression stream
-  archive->end();
   if(out->tell() != m_idx.m_original) {
     worker.sync([&]() {
       printf("Warning: Read underflow for %s\n", m_idx.m_file.cstr());
       fflush(stdout);
     });
   }
-  worker.serv().unsetLockBits(bits);
 }
 
 PackWriteJob::PackWriteJob(PackIndex& idx, Packager& pack)
@@ -176,7 +168,9 @@ void PackWriteJob::doJob(PackWaitable* wt, const jobs::JobWorker& worker) {
   // wt->m_tid = worker.id();
   if(!wt->m_stream && m_idx.filepath()) {
     wt->m_stream = new scl::stream();
-    wt->m_stream->open(m_idx.filepath(), OpenMode::READ, true);
+    // Mapped sources are compressed straight from the mapping, in one write
+    if(!wt->m_stream->open(m_idx.filepath(), OpenMode::MAP))
+      wt->m_stream->open(m_idx.filepath(), OpenMode::READ, true);
   }
   reduce->seek(StreamPos::start, 0);
   m_idx->seek(StreamPos::end, 0);
@@ -190,11 +184,15 @@ void PackWriteJob::doJob(PackWaitable* wt, const jobs::JobWorker& worker) {
     reduce->reserve(ask);
   m_idx->seek(StreamPos::start, 0);
   reduce->begin(reduce_stream::Compress);
-  reduce->write(*wt->m_stream, ask);
+  // Hash the source on its way into the compressor, mapped sources still go
+  // through in one write
+  scl::hash_stream tee(*reduce);
+  tee.write(*wt->m_stream, ask);
   reduce->end();
   // Update index
   m_idx.m_size     = reduce->tell();
   m_idx.m_original = ask;
+  m_idx.m_hash     = tee.digest();
   wt->m_stream->close();
   delete wt->m_stream;
   wt->m_stream = reduce;
@@ -204,7 +202,8 @@ void PackWriteJob::doJob(PackWaitable* wt, const jobs::JobWorker& worker) {
   m_idx.m_active = false;
 }
 
-Packager::Packager(int nworkers) : m_serv(nworkers) {
+Packager::Packager(int nworkers, bool icase)
+    : m_serv(nworkers), m_io(&m_serv), m_index(0, icase, icase) {
   m_workers = m_serv.workerCount();
   m_waiting = 0;
 }
@@ -214,6 +213,7 @@ Packager::~Packager() {
 }
 
 bool Packager::readIndex(scl::reduce_stream& archive, uint32_t bid) {
+  SCL_PROFILE_SCOPE("Packager::readIndex");
   uint32_t off;
   uint8_t  header[SPK_HEADER_SIZE];
   archive.seek(StreamPos::start, 0);
@@ -224,29 +224,26 @@ bool Packager::readIndex(scl::reduce_stream& archive, uint32_t bid) {
   }
   // Check if pack is within member bounds, and has the same build id
   if(header[SPK_H_MID] >= header[SPK_H_NMEMBS] ||
-     *(uint32_t*)&header[SPK_H_BID] != bid) {
+     load_le<uint32_t>(header + SPK_H_BID) != bid) {
     fprintf(stderr,
       "Skipping pack that is not a member of this pack family.\n");
     return true;
   }
-  off = *(uint32_t*)&header[SPK_H_IOFF];
+  off = load_le<uint32_t>(header + SPK_H_IOFF);
 
   archive.seek(StreamPos::start, off);
   while(true) {
     PackIndex idx;
-    uint16_t  len;
-    archive.read(&len, 2);
-    if(!len)
+    uint32_t  fields[3];
+    // Path, then offset, size, and original size. An empty path ends the
+    // table.
+    if(!archive.read_string<uint16_t>(idx.m_file) || !idx.m_file.len() ||
+       !archive.read_array(fields, 3))
       break;
-    char* buf  = new char[len + 1];
-    buf[len]   = 0;
-    idx.m_file = scl::path();
-    archive.read(buf, len);
-    idx.m_file.claim(buf);
-    idx.m_family = this;
-    archive.read(&idx.m_off, 4);
-    archive.read(&idx.m_size, 4);
-    archive.read(&idx.m_original, 4);
+    idx.m_off      = fields[0];
+    idx.m_size     = fields[1];
+    idx.m_original = fields[2];
+    idx.m_family   = this;
     idx.m_pack = header[SPK_H_MID];
     if(!idx.m_off || !idx.m_size || !idx.m_original) {
       // malformed
@@ -272,14 +269,16 @@ bool Packager::open(const scl::path& path) {
   if(path.exists()) {
     char                header[SPK_HEADER_SIZE];
     scl::reduce_stream* arc = new scl::reduce_stream();
-    arc->open(path, OpenMode::READ);
+    arc->open(path, m_io.uring() ? OpenMode::READ : OpenMode::MAP);
+    // Entries are fetched in whatever order they are opened
+    arc->advise(Advice::RANDOM);
     arc->read(header, SPK_HEADER_SIZE);
     if(header[SPK_H_MAJOR] != SPK_MAJOR) {
       fprintf(stderr, "Pack version mismatch. Will not proceed.\n");
       arc->close();
       return false;
     }
-    uint32_t bid = *(uint32_t*)&header[SPK_H_BID];
+    uint32_t bid = load_le<uint32_t>(header + SPK_H_BID);
     if(!readIndex(*arc, bid)) {
       arc->close();
       return false;
@@ -287,8 +286,8 @@ bool Packager::open(const scl::path& path) {
     m_archives.reserve(header[SPK_H_NMEMBS]);
     m_archives.push_back(arc);
     // Find member packs
-    auto mpacks = scl::path::glob(
-      scl::string::fmt("%s_*%s", m_family.cstr(), m_ext.cstr()));
+    auto mpacks =
+      scl::path::glob(scl::format(SCL_FMT("{}_*{}"), m_family, m_ext));
 
     if(mpacks.size() < header[SPK_H_NMEMBS] - 1) {
       fprintf(stderr, "One or more packs are missing.\n");
@@ -298,9 +297,10 @@ bool Packager::open(const scl::path& path) {
 
     for(auto& i : mpacks) {
       scl::reduce_stream* arc = new scl::reduce_stream();
-      arc->open(i, OpenMode::READ);
+      arc->open(i, m_io.uring() ? OpenMode::READ : OpenMode::MAP);
       if(!arc->is_open())
         continue;
+      arc->advise(Advice::RANDOM);
       if(!readIndex(*arc, bid)) {
         arc->close();
         continue;
@@ -318,10 +318,23 @@ bool Packager::open(const scl::path& path) {
   return true;
 }
 
+void Packager::fetch(PackIndex& idx) {
+  scl::reduce_stream* archive = m_archives[idx.m_pack];
+  char*               src     = new char[idx.m_size];
+  PackIndex*          pidx    = &idx;
+  // The read runs in the background, overlapping with other reads and
+  // decompressions. Decompression is handed to the job server once it is done.
+  bool                queued  = m_io.read(*archive, idx.m_off, src, idx.m_size,
+                    [this, pidx, src](long long r) {
+      m_serv.submitJob(new PackFetchJob(*pidx, *this, src, r));
+    });
+  if(!queued)
+    m_serv.submitJob(new PackFetchJob(idx, *this, src, -1));
+}
+
 PackIndex* Packager::openFile(const path& path) {
   // Syncronous, cause it gotta be. (its cheap-ish).
   lock();
-  m_serv.waitidle();
   auto idx = m_index.find(path);
   if(idx == m_index.end() || !idx->second.m_size) {
     // File does not exist in index, so make a new active one.
@@ -341,7 +354,7 @@ PackIndex* Packager::openFile(const path& path) {
     // File is indexed, but not active.
     idx->second.m_wt     = PackWaitable(new scl::stream());
     idx->second.m_active = true;
-    auto& wt = m_serv.submitJob(new PackFetchJob(idx->second, *this));
+    fetch(idx->second);
     unlock();
     return &idx->second;
   }
@@ -350,6 +363,17 @@ PackIndex* Packager::openFile(const path& path) {
 std::vector<PackIndex*> Packager::openFiles(
   const std::vector<scl::path>& files) {
   std::vector<PackIndex*> indices;
+  // Get the disk going on every entry first, so the fetches issued below
+  // find their data cached, instead of each one waiting on its own read.
+  lock();
+  for(auto& i : files) {
+    auto idx = m_index.find(i);
+    if(idx != m_index.end() && idx->second.m_size &&
+       !idx->second.m_active && idx->second.m_pack < m_archives.size())
+      m_archives[idx->second.m_pack]->prefetch(idx->second.m_off,
+        idx->second.m_size);
+  }
+  unlock();
   for(auto& i : files) {
     indices.push_back(openFile(i));
   }
@@ -373,12 +397,13 @@ Packager::mPackRes Packager::writeMemberPack(scl::stream& archive,
   std::function<void(size_t, PackIndex*)>& cb) {
   scl::path outpath;
   if(!memberid)
-    outpath = scl::string::fmt("%s%s", m_family.cstr(), m_ext.cstr());
+    outpath = scl::format(SCL_FMT("{}{}"), m_family, m_ext);
   else
-    outpath =
-      scl::string::fmt("%s_%i%s", m_family.cstr(), memberid, m_ext.cstr());
+    outpath = scl::format(SCL_FMT("{}_{}{}"), m_family, memberid, m_ext);
 
-  archive.open(outpath, OpenMode::RWTRUNC, true);
+  // Packs are written once front to back, and not read back soon, so keep
+  // them out of the page cache
+  archive.open(outpath, OpenMode::DIRECT, true);
 
   // Setup and write pack header
   char header[SPK_HEADER_SIZE];
@@ -390,11 +415,11 @@ Packager::mPackRes Packager::writeMemberPack(scl::stream& archive,
   memcpy(&header[SPK_H_BID], buildid.cstr(), 4);
   archive.write(header, SPK_HEADER_SIZE);
 
-  size_t      itabsize = 0;
-  scl::stream itab;
-  size_t      off     = SPK_HEADER_SIZE;
-  mPackRes    res     = mPackRes::OK;
-  bool        written = false;
+  size_t            itabsize = 0;
+  scl::chunk_stream itab;
+  size_t            off     = SPK_HEADER_SIZE;
+  mPackRes          res     = mPackRes::OK;
+  bool              written = false;
   for(; elemid < m_submitted.size(); elemid++) {
     // Grab the front of the async queue
     auto* aidx = m_writing.front();
@@ -442,13 +467,10 @@ Packager::mPackRes Packager::writeMemberPack(scl::stream& archive,
     m_remux.lock();
     m_reduces.push(reduce);
     m_remux.unlock();
-    uint16_t filelen = aidx->m_file.len();
-    // Write itab entry;
-    itab.write(&filelen, 2, SCL_STREAM_BUF);
-    itab.write(aidx->m_file);
-    itab.write(&aidx->m_off, 4);
-    itab.write(&aidx->m_size, 4);
-    itab.write(&aidx->m_original, 4);
+    // Write itab entry
+    uint32_t fields[] = {aidx->m_off, aidx->m_size, aidx->m_original};
+    itab.write_string<uint16_t>(aidx->m_file);
+    itab.write_array(fields, 3);
     m_writing.pop();
     if(elemid + m_workers < m_submitted.size()) {
       m_serv.submitJob(
@@ -461,15 +483,18 @@ Packager::mPackRes Packager::writeMemberPack(scl::stream& archive,
     written = true;
   }
   // Write itab endstop
-  uint16_t zero = 0;
-  itab.write(&zero, 2);
+  itab.write((uint16_t)0);
   itabsize += 2;
   // Write itab at the end of the archive
-  itab.seek(StreamPos::start, 0);
-  archive.write(itab, itabsize);
+  itab.write_to(archive);
   // Write itab offset in the archive header
   archive.seek(StreamPos::start, SPK_H_IOFF);
-  archive.write(&off, 4);
+  archive.write((uint32_t)off);
+  // Direct writes land in the background, a failure only shows up here
+  if(archive.failed()) {
+    fprintf(stderr, "could not write %s\n", outpath.cstr());
+    res = mPackRes::GENERAL_ERROR;
+  }
   return res;
 }
 
@@ -477,12 +502,6 @@ bool Packager::write(std::function<void(size_t, PackIndex*)> cb) {
   const char maversion = 1;
   const char miversion = 0;
 
-  if(!is_little_endiann()) {
-    fprintf(stderr, "SPK only configured for little endian systems\n");
-    fflush(stderr);
-    throw "SPK only configured for little endian systems";
-  }
-
   if(m_submitted.empty())
     return true;
 
@@ -497,9 +516,15 @@ bool Packager::write(std::function<void(size_t, PackIndex*)> cb) {
   size_t                    elem = 0;
   int                       mid  = 0;
   // Prepare the job server
+  m_io.wait();
   m_serv.clearjobs();
   m_serv.waitidle();
   m_serv.slow(false);
+  // Archives are memory mapped, and truncating a mapped file is undefined, so
+  // drop them before the packs get rewritten.
+  for(auto& i : m_archives)
+    delete i;
+  m_archives.clear();
   // Prepare reduce streams
   for(int i = 0; i < m_workers; i++)
     m_reduces.push(new scl::reduce_stream());
@@ -512,7 +537,8 @@ bool Packager::write(std::function<void(size_t, PackIndex*)> cb) {
     i++;
   }
   archives.push_back(new scl::stream());
-  while(writeMemberPack(*archives[mid], elem, mid, buildid, cb) ==
+  mPackRes res;
+  while((res = writeMemberPack(*archives[mid], elem, mid, buildid, cb)) ==
         mPackRes::WOVERFLOW) {
     mid++;
     archives.push_back(new scl::stream());
@@ -523,17 +549,18 @@ bool Packager::write(std::function<void(size_t, PackIndex*)> cb) {
   const uint8_t nmems = mid + 1;
   for(auto i : archives) {
     i->seek(StreamPos::start, SPK_H_NMEMBS);
-    i->write(&nmems, 1);
+    if(!i->write(nmems))
+      res = mPackRes::GENERAL_ERROR;
     i->close();
     delete i;
   }
   archives.clear();
   unlock();
   close();
-  return true;
+  return res == mPackRes::OK;
 }
 
-const std::unordered_map<scl::string, PackIndex>& Packager::index() {
+const PackMap& Packager::index() {
   return m_index;
 }
 
@@ -546,6 +573,7 @@ PackIndex* Packager::operator[](const scl::string& path) {
 
 void Packager::close() {
   lock();
+  m_io.wait();
   m_serv.stop();
   m_serv.clearjobs();
   for(auto& i : m_archives) {
@@ -10,6 +10,7 @@
 #include "scldict.hpp"
 #include "sclpath.hpp"
 #include "scljobs.hpp"
+#include "sclio.hpp"
 #include <unordered_map>
 
 #define SCL_MAX_CHUNKS 4
@@ -61,6 +62,7 @@ class PackIndex {
   uint32_t     m_off = 0, m_size = 0, m_original = 0;
   bool         m_active = 0, m_submitted = 0;
   uint8_t      m_pack = 0;
+  uint64_t     m_hash = 0;
 
  public:
   PackIndex(const scl::string& file = "");
@@ -96,6 +98,16 @@ class PackIndex {
     return m_original;
   }
 
+  /**
+   * @brief Returns the XXH64 of this file's original content, computed while
+   * it was compressed or decompressed. Compare it to a known value to verify
+   * a file.
+   * Returns 0 if the file hasnt been written or loaded yet.
+   */
+  uint64_t hash() const {
+    return m_hash;
+  }
+
   /**
    * @brief Returns this file's waitable.
    *  Note: The waitable's stream is NULL if
@@ -167,18 +179,23 @@ class PackIndex {
   void release();
 };
 
-// Job to decompress a file from a stream into memory
+// Job to decompress a file, read from an archive, into memory
 class PackFetchJob : public jobs::job<PackWaitable> {
   PackIndex& m_idx;
   Packager&  m_pack;
+  char*      m_src;
+  long long  m_read;
 
  public:
-  PackFetchJob(PackIndex& idx, Packager& pack);
+  /**
+   * @param  src  Compressed data of the file. Owned by the job.
+   * @param  read  Number of bytes read into `src`, or -1 on error.
+   */
+  PackFetchJob(PackIndex& idx, Packager& pack, char* src, long long read);
+  ~PackFetchJob() override;
 
   PackWaitable* getWaitable() const override;
 
-  bool          checkJob(const jobs::JobWorker& worker) const override;
-
   void          doJob(PackWaitable* wt, const jobs::JobWorker& worker) override;
 };
 
@@ -197,6 +214,9 @@ class PackWriteJob : public jobs::job<PackWaitable> {
   void          doJob(PackWaitable* wt, const jobs::JobWorker& worker) override;
 };
 
+using PackMap = std::unordered_map<scl::string, PackIndex, scl::string_hash,
+  scl::string_equal>;
+
 /**
  * @brief Class representing a family of asset packages.
  *  Allows you to read, write, etc.
@@ -209,9 +229,11 @@ class Packager : protected std::mutex {
 
  private:
   jobs::JobServer                            m_serv;
+  // Archive reads. Destroyed before m_serv, which runs its fallback jobs
+  io::engine                                 m_io;
   scl::path                                  m_family;
   scl::path                                  m_ext;
-  std::unordered_map<scl::string, PackIndex> m_index;
+  PackMap                                    m_index;
   std::vector<PackIndex*>                    m_submitted;
   std::vector<scl::reduce_stream*>           m_archives;
   // Reduce queue mutex
@@ -233,11 +255,16 @@ class Packager : protected std::mutex {
   };
 
   bool     readIndex(scl::reduce_stream& archive, uint32_t bid);
+  void     fetch(PackIndex& idx);
   mPackRes writeMemberPack(scl::stream& archive, size_t& elemid, int memberid,
     const scl::string& buildid, std::function<void(size_t, PackIndex*)>& cb);
 
  public:
-  Packager(int nworkers = INT_MAX);
+  /**
+   * @param  nworkers  Max number of worker threads.
+   * @param  icase  If true, file paths are looked up ignoring ASCII case.
+   */
+  Packager(int nworkers = INT_MAX, bool icase = false);
   ~Packager();
 
   /**
@@ -298,7 +325,7 @@ class Packager : protected std::mutex {
    *
    * @return
    */
-  const std::unordered_map<scl::string, PackIndex>& index();
+  const PackMap& index();
 
   PackIndex* operator[](const scl::string& path);
 
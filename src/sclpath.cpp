@@ -3,6 +3,7 @@
  */
 
 #include "sclpath.hpp"
+#include "sclprof.hpp"
 #include <sys/stat.h>
 
 #ifdef _WIN32
@@ -43,6 +44,10 @@ path::path(const char* rhs) : string(rhs) {
   replace("\\", "/");
 }
 
+path::path(const slice& rhs) : string(rhs.copy()) {
+  replace("\\", "/");
+}
+
 path& path::fixendsplit() {
   unsigned p = len() - 1;
   for(char c; p != (unsigned)-1 && (c = (*this)[p]) && (c == '/' || c == '\\');
@@ -154,12 +159,11 @@ std::vector<path> path::split() const {
   while(*s && *p) {
     while(*p && *p != '/' && *p != '\\')
       p++;
-    string sym = substr(unsigned(s - cstr()), unsigned(p - s));
+    slice sym(s, unsigned(p - s));
     if(sym.ffi("**") > 0)
-      sym = "**";
-    else if(!sym)
-      sym = "";
-    syms.push_back(sym);
+      syms.push_back("**");
+    else
+      syms.push_back(sym);
     while(*p == '/' || *p == '\\')
       p++;
     s = p;
@@ -534,22 +538,13 @@ static void glob_singlepattern(std::vector<path>& finds, const string& pattern,
 }
 
 std::vector<path> path::glob(const string& pattern, GlobMode mode) {
-  std::vector<string> searches;
-  const char*         sp = pattern.cstr();
-  while(true) {
-    scl::string tmp = sp;
-    auto        p   = tmp.ffi(";");
-    if(p <= 0) {
-      searches.push_back(tmp);
-      break;
-    }
-    searches.push_back(tmp.substr(0, (unsigned)p));
-    sp += p + 1;
-  }
+  SCL_PROFILE_SCOPE("path::glob");
   std::vector<path> finds;
-  for(const auto& search : searches)
-    glob_singlepattern(finds, search, mode);
-  return std::move(finds);
+  for(const slice& search : slice(pattern).split(";")) {
+    if(search)
+      glob_singlepattern(finds, search.copy(), mode);
+  }
+  return finds;
 }
 
 path path::join(std::vector<path> components, bool ignoreback) {
@@ -572,16 +567,12 @@ path path::join(std::vector<path> components, bool ignoreback) {
 }
 
 std::vector<path> path::splitPaths(const scl::string& paths) {
-  const char *      ps = paths.cstr(), *s = ps;
   std::vector<path> out;
-  while(*ps) {
-    auto p = scl::string::ffi(ps, ";");
-    if(p < 0)
-      p = (long long)strlen(ps);
-    out.push_back(paths.substr(unsigned(ps - s), (unsigned)p));
-    ps += p + 1;
+  for(const slice& p : slice(paths).split(";")) {
+    if(p)
+      out.push_back(p);
   }
-  return std::move(out);
+  return out;
 }
 
 path& path::join(const path& rhs, bool relative) {
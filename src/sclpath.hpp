@@ -23,6 +23,7 @@ class path : public string {
   path();
   path(const string &rhs);
   path(const char *rhs);
+  path(const slice &rhs);
 
   /**
    * @return Full OS path of this path.
@@ -0,0 +1,136 @@
+/*  sclpipe.cpp
+ *  Bounded pipe stream between threads
+ */
+
+#include "sclpipe.hpp"
+#include <thread>
+
+/* Waits a bit before retrying. Spins first, as the other end is usually only
+ * a memcpy away, then yields, then sleeps. */
+static void pipe_backoff(unsigned& spins) {
+  if(spins < 64)
+    spins++;
+  else if(spins < 128) {
+    spins++;
+    std::this_thread::yield();
+  } else
+    scl::waitms(SCL_PIPE_SLEEP);
+}
+
+namespace scl {
+pipe::pipe(size_t capacity, unsigned producers) : m_writers(producers) {
+  size_t cap = 64;
+  while(cap < capacity)
+    cap <<= 1;
+  m_ring = (char*)m_alloc->allocate(cap);
+  if(!m_ring)
+    throw "scl::pipe could not allocate its ring";
+  m_mask = cap - 1;
+}
+
+pipe::~pipe() {
+  m_alloc->deallocate(m_ring, m_mask + 1);
+}
+
+bool pipe::passthrough() const {
+  // Bytes live in the ring, not in a stream buffer
+  return false;
+}
+
+long long pipe::read(void* buf, size_t n) {
+  char*    out   = (char*)buf;
+  size_t   got   = 0;
+  unsigned spins = 0;
+  while(got < n) {
+    size_t h = m_head.load(std::memory_order_relaxed);
+    size_t t = m_tail.load(std::memory_order_acquire);
+    if(t == h) {
+      // Producers publish before they end, so check the tail again after
+      if((!m_writers.load(std::memory_order_acquire) &&
+           m_tail.load(std::memory_order_acquire) == h) ||
+         m_closed.load(std::memory_order_relaxed))
+        break;
+      pipe_backoff(spins);
+      continue;
+    }
+    spins      = 0;
+    size_t c   = std::min(n - got, t - h);
+    size_t off = h & m_mask;
+    size_t c1  = std::min(c, m_mask + 1 - off);
+    memcpy(out + got, m_ring + off, c1);
+    memcpy(out + got + c1, m_ring, c - c1);
+    m_head.store(h + c, std::memory_order_release);
+    got += c;
+  }
+  return got;
+}
+
+bool pipe::write(const void* buf, size_t n, size_t, bool) {
+  const char* in = (const char*)buf;
+  while(n) {
+    // Writes up to the capacity are claimed at once, so they stay in one piece
+    size_t   c     = std::min(n, m_mask + 1);
+    size_t   t     = m_claim.load(std::memory_order_relaxed);
+    unsigned spins = 0;
+    for(;;) {
+      if(m_closed.load(std::memory_order_relaxed))
+        return false;
+      if(t + c - m_head.load(std::memory_order_acquire) <= m_mask + 1) {
+        if(m_claim.compare_exchange_weak(t, t + c, std::memory_order_relaxed))
+          break;
+        continue;
+      }
+      pipe_backoff(spins);
+      t = m_claim.load(std::memory_order_relaxed);
+    }
+    size_t off = t & m_mask;
+    size_t c1  = std::min(c, m_mask + 1 - off);
+    memcpy(m_ring + off, in, c1);
+    memcpy(m_ring, in + c1, c - c1);
+    // Publish in claim order, after producers that claimed space before us
+    spins = 0;
+    while(m_tail.load(std::memory_order_acquire) != t)
+      pipe_backoff(spins);
+    m_tail.store(t + c, std::memory_order_release);
+    in += c;
+    n -= c;
+  }
+  return true;
+}
+
+void pipe::end() {
+  m_writers.fetch_sub(1, std::memory_order_release);
+}
+
+void pipe::close() {
+  m_closed.store(true, std::memory_order_relaxed);
+}
+
+size_t pipe::available() const {
+  return m_tail.load(std::memory_order_acquire) -
+         m_head.load(std::memory_order_relaxed);
+}
+
+size_t pipe::capacity() const {
+  return m_mask + 1;
+}
+
+long long pipe::tell() const {
+  return m_head.load(std::memory_order_relaxed);
+}
+
+long long pipe::seek(StreamPos, long long) {
+  return tell();
+}
+
+void pipe::flush() {
+}
+
+long long pipe::read_at(long long, void*, size_t) {
+  return 0;
+}
+
+bool pipe::write_at(long long, const void*, size_t) {
+  return false;
+}
+} // namespace scl
@@ -0,0 +1,120 @@
+/*  sclpipe.hpp
+ *  Bounded pipe stream between threads
+ */
+
+#ifndef SCL_PIPE_H
+#define SCL_PIPE_H
+
+#include <atomic>
+#include "sclcore.hpp"
+
+// Default capacity in bytes of a scl::pipe.
+#ifndef SCL_PIPE_BUF
+#  define SCL_PIPE_BUF 0x40000
+#endif
+
+// Milliseconds a blocked pipe end sleeps for, once done spinning.
+#ifndef SCL_PIPE_SLEEP
+#  define SCL_PIPE_SLEEP 0.02
+#endif
+
+namespace scl {
+/**
+ * @brief  Fixed size, lock-free ring buffer between one or more producer
+ * threads and a single consumer thread. Producers write() into it while the
+ * consumer read()s out of it, so stages of a job chain can run at the same
+ * time instead of each one buffering a whole file first.
+ *
+ * write() blocks while the pipe is full, and read() while it is empty. Once
+ * every producer called end(), read() returns what is left, then 0. Writes up
+ * to the capacity of the pipe are never interleaved with other producers'.
+ * @warning  Only one thread may read. The pipe has no position, so seeking and
+ * positional reads or writes are not supported.
+ */
+class pipe : public stream {
+  char*                 m_ring = nullptr;
+  size_t                m_mask = 0;
+  // Read position. Only moved by the consumer.
+  std::atomic<size_t>   m_head{0};
+  // Keeps the consumer's and producers' counters on separate cache lines
+  char                  m_pad[64];
+  // End of the space producers have claimed
+  std::atomic<size_t>   m_claim{0};
+  // End of the bytes handed to the consumer, always <= m_claim
+  std::atomic<size_t>   m_tail{0};
+  std::atomic<unsigned> m_writers;
+  std::atomic<bool>     m_closed{false};
+
+ protected:
+  bool passthrough() const override;
+
+ public:
+  /**
+   * @param  capacity  Size of the ring in bytes. Rounded up to a power of two.
+   * @param  producers  Number of producers. Each must call end() once done.
+   */
+  pipe(size_t capacity = SCL_PIPE_BUF, unsigned producers = 1);
+  ~pipe() override;
+
+  pipe(const pipe&)            = delete;
+  pipe& operator=(const pipe&) = delete;
+
+  /**
+   * @brief  Reads `n` bytes, waiting for producers as needed.
+   *
+   * @return  Number of bytes read. Less than `n` only once every producer has
+   * called end(), or the pipe was closed.
+   */
+  using stream::read;
+  long long read(void* buf, size_t n) override;
+
+  /**
+   * @brief  Writes `n` bytes, waiting for the consumer to make room as needed.
+   *
+   * @return  false if the pipe was closed by the consumer.
+   */
+  using stream::write;
+  bool      write(const void* buf, size_t n, size_t align = 1,
+         bool flush = false) override;
+
+  /**
+   * @brief  Marks one producer as done writing.
+   */
+  void      end();
+
+  /**
+   * @brief  Closes the consumer end. Pending and future writes fail.
+   */
+  void      close() override;
+
+  /**
+   * @return  Number of bytes ready to be read.
+   */
+  size_t    available() const;
+
+  /**
+   * @return  Capacity of the ring in bytes.
+   */
+  size_t    capacity() const;
+
+  /**
+   * @return  Number of bytes read so far.
+   */
+  long long tell() const override;
+
+  /**
+   * @brief  Not supported. Returns tell().
+   */
+  long long seek(StreamPos pos, long long off) override;
+
+  /**
+   * @brief  Does nothing, writes are visible to the consumer right away.
+   */
+  void      flush() override;
+
+  long long read_at(long long off, void* buf, size_t n) override;
+  bool      write_at(long long off, const void* buf, size_t n) override;
+};
+} // namespace scl
+
+#endif
@@ -0,0 +1,156 @@
+/*  sclprof.cpp
+ *  Built-in profiling zones
+ */
+
+#include "sclprof.hpp"
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+
+struct profile_event {
+  const char* name;
+  uint64_t    begin;
+  uint64_t    end;
+};
+
+/* Zones of one thread. Only that thread appends, and publishes each zone by
+ * bumping count, so exporting never has to stop it. Kept after the thread
+ * exits, so its zones can still be exported, and handed to the next thread
+ * that starts recording, which appends after them. */
+struct profile_buffer {
+  unsigned            tid;
+  std::atomic<size_t> count{0};
+  profile_event       events[SCL_PROFILE_EVENTS];
+};
+
+static std::atomic<bool>             prof_enabled{false};
+static std::atomic<size_t>           prof_dropped{0};
+static std::mutex                    prof_mux;
+// Never destroyed, as threads may still record while the process exits
+static std::vector<profile_buffer*>* prof_buffers =
+  new std::vector<profile_buffer*>();
+// Buffers of exited threads, waiting for a new owner
+static std::vector<profile_buffer*>* prof_free =
+  new std::vector<profile_buffer*>();
+
+/* This thread's buffer, released when the thread exits. */
+struct profile_owner {
+  profile_buffer* buf = nullptr;
+
+  ~profile_owner() {
+    if(!buf)
+      return;
+    std::lock_guard<std::mutex> lock(prof_mux);
+    prof_free->push_back(buf);
+  }
+};
+
+static thread_local profile_owner prof_local;
+
+/* Writes `str` as the contents of a JSON string. */
+static bool prof_write_str(scl::stream& out, const char* str) {
+  const char* run = str;
+  for(; *str; str++) {
+    if(*str != '"' && *str != '\\')
+      continue;
+    if(!out.write(run, str - run) || !out.write("\\", 1))
+      return false;
+    run = str;
+  }
+  return out.write(run, str - run);
+}
+
+namespace scl {
+namespace profile {
+void start() {
+  // Calibrate now, not while exporting
+  cyclerate();
+  prof_enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop() {
+  prof_enabled.store(false, std::memory_order_relaxed);
+}
+
+bool enabled() {
+  return prof_enabled.load(std::memory_order_relaxed);
+}
+
+void clear() {
+  std::lock_guard<std::mutex> lock(prof_mux);
+  for(profile_buffer* b : *prof_buffers)
+    b->count.store(0, std::memory_order_relaxed);
+  prof_dropped.store(0, std::memory_order_relaxed);
+}
+
+size_t dropped() {
+  return prof_dropped.load(std::memory_order_relaxed);
+}
+
+void record(const char* name, uint64_t begin, uint64_t end) {
+  profile_buffer* buf = prof_local.buf;
+  if(!buf) {
+    std::lock_guard<std::mutex> lock(prof_mux);
+    if(!prof_free->empty()) {
+      buf = prof_free->back();
+      prof_free->pop_back();
+    } else {
+      // Left uninitialized, only the published part of events is ever read
+      buf      = new profile_buffer;
+      buf->tid = (unsigned)prof_buffers->size() + 1;
+      prof_buffers->push_back(buf);
+    }
+    prof_local.buf = buf;
+  }
+  size_t n = buf->count.load(std::memory_order_relaxed);
+  if(n >= SCL_PROFILE_EVENTS) {
+    prof_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buf->events[n] = {name, begin, end};
+  buf->count.store(n + 1, std::memory_order_release);
+}
+
+bool write(stream& out) {
+  // Microseconds per cycle
+  double                      scale = 1e6 / cyclerate();
+  std::lock_guard<std::mutex> lock(prof_mux);
+  // The earliest zone starts the trace
+  uint64_t                    base  = UINT64_MAX;
+  for(profile_buffer* b : *prof_buffers) {
+    size_t n = b->count.load(std::memory_order_acquire);
+    for(size_t i = 0; i < n; i++)
+      base = std::min(base, b->events[i].begin);
+  }
+  bool first = true;
+  if(!out.write("{\"traceEvents\":[", 16))
+    return false;
+  for(profile_buffer* b : *prof_buffers) {
+    size_t n = b->count.load(std::memory_order_acquire);
+    for(size_t i = 0; i < n; i++) {
+      const profile_event& e    = b->events[i];
+      const char*          head = first ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+      char                 tail[128];
+      int                  l    = snprintf(tail, sizeof(tail),
+        "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+        b->tid, (double)(e.begin - base) * scale,
+        (double)(e.end - e.begin) * scale);
+      if(!out.write(head, strlen(head)) || !prof_write_str(out, e.name) ||
+         !out.write(tail, l))
+        return false;
+      first = false;
+    }
+  }
+  return out.write("\n]}\n", 4);
+}
+
+bool save(const scl::path& path) {
+  scl::stream f;
+  if(!f.open(path, OpenMode::WRITE, true))
+    return false;
+  bool r = write(f);
+  f.close();
+  return r;
+}
+} // namespace profile
+} // namespace scl
@@ -0,0 +1,116 @@
+/*  sclprof.hpp
+ *  Built-in profiling zones
+ */
+
+#ifndef SCL_PROF_H
+#define SCL_PROF_H
+
+#include "sclcore.hpp"
+
+// Max number of zones recorded per thread. Zones past it are dropped, and
+// counted by scl::profile::dropped().
+#ifndef SCL_PROFILE_EVENTS
+#  define SCL_PROFILE_EVENTS 0x10000
+#endif
+
+#define SCL_PROFILE_CAT_(a, b) a##b
+#define SCL_PROFILE_CAT(a, b)  SCL_PROFILE_CAT_(a, b)
+
+/**
+ * @brief  Records the enclosing scope as a zone named `name`, a string
+ * literal, while scl::profile::start() is in effect.
+ * Compiles to nothing unless SCL_PROFILE is defined.
+ */
+#ifdef SCL_PROFILE
+#  define SCL_PROFILE_SCOPE(name) \
+    scl::profile::zone SCL_PROFILE_CAT(scl_zone_, __LINE__)(name)
+#else
+#  define SCL_PROFILE_SCOPE(name)
+#endif
+
+namespace scl {
+/**
+ * @brief  Lightweight instrumentation. Zones are timed with scl::cycles(), and
+ * recorded into a buffer owned by the thread that ran them, without locking.
+ * The whole recording can be exported as Chrome trace JSON, and opened with
+ * chrome://tracing or Perfetto.
+ *
+ * Each buffer holds SCL_PROFILE_EVENTS zones, and is never freed. When a
+ * thread exits, its buffer goes to the next thread that records, which shows
+ * up under the same tid. So there are only ever as many buffers as threads
+ * recording at once.
+ */
+namespace profile {
+/**
+ * @brief  Starts recording zones.
+ */
+void     start();
+
+/**
+ * @brief  Stops recording zones. What was recorded is kept.
+ */
+void     stop();
+
+/**
+ * @return  true if zones are being recorded.
+ */
+bool     enabled();
+
+/**
+ * @brief  Forgets every recorded zone.
+ * @warning  No other thread may be inside a zone while clearing.
+ */
+void     clear();
+
+/**
+ * @return  Number of zones dropped because a thread's buffer was full.
+ */
+size_t   dropped();
+
+/**
+ * @brief  Records one zone into this thread's buffer.
+ *
+ * @param  name  Name of the zone. Must outlive the recording.
+ * @param  begin  scl::cycles() at the start of the zone.
+ * @param  end  scl::cycles() at the end of the zone.
+ */
+void     record(const char* name, uint64_t begin, uint64_t end);
+
+/**
+ * @brief  Writes every recorded zone as Chrome trace JSON. Can be called while
+ * other threads are still recording.
+ *
+ * @return  false if a write failed.
+ */
+bool     write(stream& out);
+
+/**
+ * @brief  Writes every recorded zone as Chrome trace JSON into a file.
+ *
+ * @return  false if the file could not be written.
+ */
+bool     save(const scl::path& path);
+
+/**
+ * @brief  Times its own scope, see SCL_PROFILE_SCOPE.
+ */
+class zone {
+  const char* m_name;
+  uint64_t    m_begin;
+
+ public:
+  zone(const char* name) : m_name(name), m_begin(enabled() ? cycles() : 0) {
+  }
+
+  zone(const zone&)            = delete;
+  zone& operator=(const zone&) = delete;
+
+  ~zone() {
+    if(m_begin)
+      record(m_name, m_begin, cycles());
+  }
+};
+} // namespace profile
+} // namespace scl
+
+#endif
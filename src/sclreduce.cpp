@@ -2,6 +2,7 @@
  */
 
 #include "sclreduce.hpp"
+#include "sclprof.hpp"
 #define LZ4F_STATIC_LINKING_ONLY
 #include "lz4/lz4frame.h"
 
@@ -65,6 +66,7 @@ size_t reduce_stream::compress_flush() {
 
 size_t reduce_stream::compress_chunk(const void* buf, size_t bytes,
   bool flush) {
+  SCL_PROFILE_SCOPE("reduce_stream::compress_chunk");
   size_t outSize;
 
   if(!m_ready || bytes > SCL_STREAM_BUF)
@@ -121,6 +123,7 @@ bool reduce_stream::decompress_init() {
 }
 
 size_t reduce_stream::decompress_chunk(void* buf, size_t bytes) {
+  SCL_PROFILE_SCOPE("reduce_stream::decompress_chunk");
   size_t ret     = 1;
   size_t written = 0;
   // Fetch and decompress data into outbuf
@@ -187,6 +190,74 @@ bool reduce_stream::decompress_begin() {
   return true;
 }
 
+long long reduce_stream::decompress(const void* src, size_t n, stream& out,
+  size_t max) {
+  SCL_PROFILE_SCOPE("reduce_stream::decompress");
+  LZ4F_dctx* ctx;
+  if(LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)))
+    return -1;
+  char*       buf   = new char[SCL_STREAM_BUF];
+  const char* srcp  = (const char*)src;
+  const char* srce  = srcp + n;
+  long long   total = 0;
+  size_t      ret   = 1;
+  while(ret && srcp < srce && (size_t)total < max) {
+    size_t dstSize = std::min((size_t)SCL_STREAM_BUF, max - (size_t)total);
+    size_t srcSize = srce - srcp;
+    ret = LZ4F_decompress(ctx, buf, &dstSize, srcp, &srcSize, NULL);
+    if(LZ4F_isError(ret) || (dstSize && !out.write(buf, dstSize))) {
+      total = -1;
+      break;
+    }
+    srcp += srcSize;
+    total += dstSize;
+  }
+  // src ended before the frame did
+  if(ret && total >= 0 && (size_t)total < max)
+    total = -1;
+  delete[] buf;
+  LZ4F_freeDecompressionContext(ctx);
+  return total;
+}
+
+long long reduce_stream::decompress(stream& src, stream& out, size_t max) {
+  SCL_PROFILE_SCOPE("reduce_stream::decompress");
+  LZ4F_dctx* ctx;
+  if(LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)))
+    return -1;
+  char*     in       = new char[SCL_STREAM_BUF];
+  char*     buf      = new char[SCL_STREAM_BUF];
+  size_t    inSize   = 0;
+  size_t    consumed = 0;
+  long long total    = 0;
+  size_t    ret      = 1;
+  while(ret && (size_t)total < max) {
+    if(consumed >= inSize) {
+      long long r = src.read(in, SCL_STREAM_BUF);
+      if(r <= 0)
+        break;
+      inSize   = (size_t)r;
+      consumed = 0;
+    }
+    size_t dstSize = std::min((size_t)SCL_STREAM_BUF, max - (size_t)total);
+    size_t srcSize = inSize - consumed;
+    ret = LZ4F_decompress(ctx, buf, &dstSize, in + consumed, &srcSize, NULL);
+    if(LZ4F_isError(ret) || (dstSize && !out.write(buf, dstSize))) {
+      total = -1;
+      break;
+    }
+    consumed += srcSize;
+    total += dstSize;
+  }
+  // src ended before the frame did
+  if(ret && total >= 0 && (size_t)total < max)
+    total = -1;
+  delete[] in;
+  delete[] buf;
+  LZ4F_freeDecompressionContext(ctx);
+  return total;
+}
+
 bool reduce_stream::decompress_end() {
   if(m_outbuf)
     delete[] m_outbuf;
@@ -364,6 +435,11 @@ bool reduce_stream::write_uncompressed(const void* buf, size_t n, size_t align,
   return write_internal(buf, n, align);
 }
 
+bool reduce_stream::passthrough() const {
+  // Reads and writes go through lz4
+  return false;
+}
+
 void reduce_stream::close() {
   // Free stream resources.
   close_internal();
@@ -35,6 +35,9 @@ class reduce_stream : public stream {
 
   void       close_internal();
 
+ protected:
+  bool       passthrough() const override;
+
 
  public:
   reduce_stream() = default;
@@ -76,6 +79,35 @@ class reduce_stream : public stream {
    */
   bool      end();
 
+  /**
+   * @brief  Decompresses a whole frame from memory into `out`. Uses its own
+   * decompression state, so it can be called from many threads at once.
+   *
+   * @param  src  Compressed data, in LZ4's frame format.
+   * @param  n  Size of `src` in bytes.
+   * @param  out  Stream to write decompressed data to.
+   * @param  max  Max number of decompressed bytes to write. By default -1
+   * (infinite).
+   * @return  Number of decompressed bytes written. -1 if the operation errored,
+   * or if `src` ends before the frame does.
+   */
+  static long long decompress(const void* src, size_t n, stream& out,
+    size_t max = -1);
+
+  /**
+   * @brief  Decompresses a whole frame read from `src`, from its rw pointer,
+   * into `out`. Never reads past the end of `src`, so a scl::substream bounds
+   * it to one entry of an archive. Thread-safe like the overload above.
+   *
+   * @param  src  Stream holding compressed data, in LZ4's frame format.
+   * @param  out  Stream to write decompressed data to.
+   * @param  max  Max number of decompressed bytes to write. By default -1
+   * (infinite).
+   * @return  Number of decompressed bytes written. -1 if the operation errored,
+   * or if `src` ends before the frame does.
+   */
+  static long long decompress(stream& src, stream& out, size_t max = -1);
+
   /**
    * @brief  Reads and decompresses data from this stream.
    * @warning  A decompression state must be started before this call (see
@@ -89,6 +121,7 @@ class reduce_stream : public stream {
    * there was nothing to read.
    */
   long long read(void* buf, size_t n) override;
+  using stream::read;
 
   /**
    * @brief  Flushes internal buffers.
@@ -10,7 +10,11 @@
 #endif
 
 #include "sclcore.hpp"
+#include "sclnum.hpp"
+#include "sclfmt.hpp"
+#include "sclprof.hpp"
 #include <vector>
+#include <new>
 
 namespace scl {
 namespace xml {
@@ -76,7 +80,7 @@ class XmlResult {
     case MISMATCH: {
       scl::string out = _errdescs[code];
       if(info)
-        out += scl::string::fmt(" (%s)", info.cstr());
+        out += format(SCL_FMT(" ({})"), info);
       return out;
     }
     default:
@@ -94,11 +98,12 @@ class XmlResult {
 template <int defaultSize = 2048>
 class XmlPage {
  private:
-  void*    data = NULL;
-  unsigned used = 0;
-  unsigned size = 0;
-  XmlPage* prev = NULL;
-  XmlPage* next = NULL;
+  void*           data = NULL;
+  unsigned        used = 0;
+  unsigned        size = 0;
+  XmlPage*        prev = NULL;
+  XmlPage*        next = NULL;
+  scl::allocator* allo = &scl::allocator::current();
 
  public:
   XmlPage(XmlPage* tonext = NULL) {
@@ -106,6 +111,7 @@ class XmlPage {
       memcpy(this, tonext, sizeof(XmlPage));
       memset(tonext, 0, sizeof(XmlPage));
       tonext->next = this;
+      tonext->allo = allo;
     }
   }
 
@@ -113,12 +119,28 @@ class XmlPage {
     for(XmlPage* page = this; page;) {
       XmlPage* next = page->next;
       if(page->data)
-        delete[](char*)page->data;
+        allo->deallocate(page->data, page->size);
       // All but the root page must be deleted manually
       if(page != this)
-        delete page;
+        allo->deallocate(page, sizeof(XmlPage));
       page = next;
     }
+    data = NULL;
+    used = 0;
+    size = 0;
+    next = NULL;
+  }
+
+  /**
+   * @brief  Sets the allocator pages are allocated from. Must be called while
+   * no pages are allocated.
+   */
+  void set_allocator(scl::allocator& alloc) {
+    allo = &alloc;
+  }
+
+  scl::allocator& get_allocator() const {
+    return *allo;
   }
 
   template <class T = char>
@@ -129,14 +151,17 @@ class XmlPage {
     if(!data) {
       unsigned req = asz > defaultSize ? asz : defaultSize;
       size         = req;
-      data         = new char[size];
+      data         = allo->allocate(size);
       if(!data)
         throw XmlResult(MEM);
     }
     if(used + asz > size) {
       /* make a new page, and swap input page for new one */
       /* saves performance and cpu time looking of open slot */
-      new XmlPage<defaultSize>(this);
+      void* page = allo->allocate(sizeof(XmlPage));
+      if(!page)
+        throw XmlResult(MEM);
+      new(page) XmlPage<defaultSize>(this);
       return alloc<T>(n);
     }
     void* ptr = (char*)data + used;
@@ -271,6 +296,12 @@ class XmlNode {
     return (*ep) = p, s != p;
   }
 
+  static const char* skip_space(const char* s) {
+    while(internal::xctypes[(unsigned char)*s] & SPACEBIT)
+      s++;
+    return s;
+  }
+
   void skip_delim(char delim, char* s, char** ep) {
     char* p = s;
     while(*p && *p != delim)
@@ -436,18 +467,45 @@ class XmlNode {
    * @return   Converts node data into a long long integer if possible.
    */
   long long data_int() const {
+    long long v = 0;
     if(m_data)
-      return atoll(m_data);
-    return 0;
+      from_chars(skip_space(m_data), nullptr, v);
+    return v;
   }
 
   /**
    * @return   Converts node data into a double if possible.
    */
   double data_float() const {
+    double v = 0.0;
     if(m_data)
-      return atof(m_data);
-    return 0.0;
+      from_chars(skip_space(m_data), nullptr, v);
+    return v;
+  }
+
+  /**
+   * @brief  Set the data of the node to a formatted integer.
+   *
+   * @param v  New data.
+   */
+  void set_data_int(long long v) {
+    char  buf[SCL_INT_CHARS];
+    char* e = to_chars(buf, buf + SCL_INT_CHARS, v);
+    m_data  = m_allo->txt.alloc((int)(e - buf) + 1);
+    memcpy(m_data, buf, e - buf);
+  }
+
+  /**
+   * @brief  Set the data of the node to a formatted double. The shortest
+   * representation that parses back into the same value is used.
+   *
+   * @param v  New data.
+   */
+  void set_data_float(double v) {
+    char  buf[SCL_FLOAT_CHARS];
+    char* e = to_chars(buf, buf + SCL_FLOAT_CHARS, v);
+    m_data  = m_allo->txt.alloc((int)(e - buf) + 1);
+    memcpy(m_data, buf, e - buf);
   }
 
   /**
@@ -509,7 +567,7 @@ class XmlAttr : public XmlNode<XmlAttr, XmlElem> {
   XmlResult print(stream& stream) {
     if(!m_tag)
       throw XmlResult(NIL, "Incomplete attr");
-    stream.write(string::fmt("%s=\"", m_tag), s);
+    format_to<s>(stream, SCL_FMT("{}=\""), m_tag);
     print_text<s>(stream, m_data);
     stream.write("\"", 1, s);
     if(m_next)
@@ -544,7 +602,7 @@ class XmlElem : public XmlNode<XmlElem, XmlElem> {
       // Check if parent tag and parsed tag are identical
       if(!!strncmp(parent->m_tag, s, p - s)) {
         *p = '\0';
-        throw XmlResult(MISMATCH, string::fmt("%s/%s", parent->m_tag, s));
+        throw XmlResult(MISMATCH, format(SCL_FMT("{}/{}"), parent->m_tag, s));
       }
     }
     leave |= 1;
@@ -658,12 +716,12 @@ class XmlElem : public XmlNode<XmlElem, XmlElem> {
       if(!m_tag)
         throw XmlResult(NIL, "Incomplete elem");
       if(level < 0)
-        throw XmlResult(LEVEL, string::fmt("level=%i", level));
+        throw XmlResult(LEVEL, scl::format(SCL_FMT("level={}"), level));
       if(level == 0 && format)
         stream.write("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n", 39, s);
       for(int i = 0; format && i < level; i++)
         stream.write("  ", 2, s);
-      stream.write(string::fmt("<%s", m_tag), s);
+      format_to<s>(stream, SCL_FMT("<{}"), m_tag);
       if(m_attr) {
         stream.write(" ", 1, s);
         for(auto& a : attributes())
@@ -681,7 +739,7 @@ class XmlElem : public XmlNode<XmlElem, XmlElem> {
           for(int i = 0; format && i < level; i++)
             stream.write("  ", 2, s);
         }
-        stream.write(string::fmt("</%s>", m_tag), s);
+        format_to<s>(stream, SCL_FMT("</{}>"), m_tag);
         if(m_parent && format)
           stream.write("\n", 1, s);
       } else {
@@ -706,11 +764,14 @@ class XmlElem : public XmlNode<XmlElem, XmlElem> {
    */
   template <int s = SCL_XML_DEFAULT_PRINT_STEP>
   XmlResult print(scl::string& str, bool format = true) {
-    scl::stream stream;
-    auto        r = print<s>(stream, format);
+    // Chunks, so big trees are not copied over each time the output grows
+    scl::chunk_stream stream;
+    auto              r = print<s>(stream, format);
     if(!r)
       return r;
-    str.claim((const char*)stream.release());
+    stream.seek(StreamPos::start, 0);
+    if(!stream.read_all(str))
+      return MEM;
     return OK;
   }
 
@@ -870,11 +931,40 @@ class XmlDocument : public XmlElem, public XmlAllocator {
  protected:
   string source;
 
+  /* Parses source in place. The caller sets up the allocator scope. */
+  template <int f>
+  XmlResult parse_source() {
+    SCL_PROFILE_SCOPE("XmlDocument::parse");
+    try {
+      int   leave;
+      char* p = (char*)source.cstr();
+      if(!p)
+        return ERR;
+      this->parse<f>(*this, leave, NULL, p, &p);
+      /* to fix the root node's m_allo member being set to NULL */
+      this->set_allocator(this);
+    } catch(XmlResult e) {
+      nodes.free();
+      return e;
+    }
+    return OK;
+  }
+
  public:
   XmlDocument() {
     m_allo = this;
   }
 
+  /**
+   * @brief  Creates a document that allocates its nodes, and the strings it
+   * loads, from `alloc`.
+   */
+  XmlDocument(scl::allocator& alloc) {
+    m_allo = this;
+    nodes.set_allocator(alloc);
+    txt.set_allocator(alloc);
+  }
+
   ~XmlDocument() {
     nodes.free();
     txt.free();
@@ -892,21 +982,10 @@ class XmlDocument : public XmlElem, public XmlAllocator {
   template <int f = none>
   XmlResult load_string(const scl::string& content) {
     this->zero();
+    scl::allocator::scope use(nodes.get_allocator());
     // Copy, because the parser is destructive
     source = content.copy();
-    try {
-      int   leave;
-      char* p = (char*)source.cstr();
-      if(!p)
-        return ERR;
-      this->parse<f>(*this, leave, NULL, p, &p);
-      /* to fix the root node's m_allo member being set to NULL */
-      this->set_allocator(this);
-    } catch(XmlResult e) {
-      nodes.free();
-      return e;
-    }
-    return OK;
+    return parse_source<f>();
   }
 
   /**
@@ -922,16 +1001,17 @@ class XmlDocument : public XmlElem, public XmlAllocator {
    */
   template <int f = none>
   XmlResult load_file(const scl::string& path, long long* read = NULL) {
-    std::ifstream fi(path.cstr());
-    if(!fi)
+    this->zero();
+    scl::allocator::scope use(nodes.get_allocator());
+    scl::stream           fi;
+    if(!fi.open(path, scl::OpenMode::READ, true))
+      return FILE;
+    // Read once, straight into the buffer that is parsed in place
+    if(!fi.read_all(source) || !source)
       return FILE;
-    fi >> source;
     if(read)
       (*read) += source.size();
-    fi.close();
-    if(!source)
-      return FILE;
-    return load_string<f>(source);
+    return parse_source<f>();
   }
 
   /**